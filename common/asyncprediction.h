@@ -0,0 +1,104 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _COMMON_ASYNCPREDICTION_H_
+#define _COMMON_ASYNCPREDICTION_H_
+
+#include "lrucache.h"
+#include "workerthread.h"
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fcitx-utils/eventdispatcher.h>
+#include <fcitx-utils/macros.h>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+
+/**
+ * Run next word prediction on a worker thread, and remember recent results.
+ *
+ * The prediction reads the dictionary and language model on the worker, so
+ * the main thread needs to hold lock() while changing them, or use
+ * invalidate() if the old data is removed. Learning is not expected to drop
+ * the cached results, it only changes the order a little.
+ */
+template <typename Result>
+class AsyncPrediction {
+public:
+    using Callback = std::function<void(const Result &)>;
+
+    static constexpr size_t CacheSize = 128;
+
+    AsyncPrediction(fcitx::EventDispatcher &dispatcher)
+        : worker_(dispatcher, 1) {}
+
+    std::unique_lock<std::mutex> lock() {
+        return std::unique_lock<std::mutex>(mutex_);
+    }
+
+    // Drop cached results, and skip the predictions that are not started yet.
+    void invalidate() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        generation_ += 1;
+        cache_.clear();
+    }
+
+    // If key is cached, onDone is invoked right away and nullptr is returned.
+    // Otherwise predict runs on the worker, and onDone is invoked on the main
+    // thread later, unless the returned token is destroyed before that.
+    FCITX_NODISCARD std::unique_ptr<TaskToken>
+    predict(std::string key, std::function<Result()> predict,
+            Callback onDone) {
+        if (const auto *cached = cache_.find(key)) {
+            // Copy, onDone may start another prediction and evict it.
+            const Result result = *cached;
+            onDone(result);
+            return nullptr;
+        }
+        std::packaged_task<std::optional<Result>()> task(
+            [this, generation = generation_,
+             predict = std::move(predict)]() -> std::optional<Result> {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (generation != generation_) {
+                    return std::nullopt;
+                }
+                return predict();
+            });
+        return worker_.addTask(
+            std::move(task),
+            [this, key = std::move(key), onDone = std::move(onDone)](
+                std::shared_future<std::optional<Result>> &future) {
+                std::optional<Result> result;
+                try {
+                    result = future.get();
+                } catch (const std::exception &) {
+                }
+                if (!result) {
+                    onDone(Result());
+                    return;
+                }
+                cache_.insert(key, *result);
+                onDone(*result);
+            });
+    }
+
+private:
+    // Only accessed on the main thread.
+    LRUCache<std::string, Result> cache_{CacheSize};
+    std::mutex mutex_;
+    // Changed on the main thread with mutex_ held.
+    uint64_t generation_ = 0;
+    // Must be the last member, pending predictions are finished on
+    // destruction.
+    WorkerThread worker_;
+};
+
+#endif // _COMMON_ASYNCPREDICTION_H_
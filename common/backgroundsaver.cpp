@@ -0,0 +1,98 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "backgroundsaver.h"
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <exception>
+#include <fcitx-utils/event.h>
+#include <fcitx-utils/eventdispatcher.h>
+#include <fcitx-utils/eventloopinterface.h>
+#include <fcitx-utils/fdstreambuf.h>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/standardpaths.h>
+#include <future>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+
+BackgroundSaver::BackgroundSaver(fcitx::EventLoop &loop,
+                                 fcitx::EventDispatcher &dispatcher,
+                                 std::function<void()> autoSave)
+    : autoSave_(std::move(autoSave)), worker_(dispatcher, 1) {
+    timer_ = loop.addTimeEvent(CLOCK_MONOTONIC, 0, 0,
+                               [this](fcitx::EventSourceTime *, uint64_t) {
+                                   dirtySince_ = 0;
+                                   autoSave_();
+                                   return true;
+                               });
+    timer_->setEnabled(false);
+}
+
+BackgroundSaver::~BackgroundSaver() = default;
+
+void BackgroundSaver::save(std::string path, Writer writer) {
+    run([path = std::move(path), writer = std::move(writer)]() {
+        auto result = fcitx::StandardPaths::global().safeSave(
+            fcitx::StandardPathsType::PkgData, path, [&writer](int fd) {
+                fcitx::OFDStreamBuf buffer(fd);
+                std::ostream out(&buffer);
+                try {
+                    return writer(out) && static_cast<bool>(out);
+                } catch (const std::exception &e) {
+                    FCITX_ERROR() << "Failed to write data: " << e.what();
+                    return false;
+                }
+            });
+        if (!result) {
+            FCITX_ERROR() << "Failed to save " << path;
+        }
+        return result;
+    });
+}
+
+void BackgroundSaver::run(std::function<bool()> task) {
+    std::packaged_task<void()> wrapped([this, task = std::move(task)]() {
+        if (!task()) {
+            failed_ = true;
+        }
+    });
+    tasks_.push_back(
+        worker_.addTask(std::move(wrapped), [this](std::shared_future<void> &) {
+            // Only one thread, so tasks are always finished in order.
+            tasks_.pop_front();
+        }));
+}
+
+void BackgroundSaver::afterSaved(std::function<void()> task,
+                                 std::function<void(bool)> onDone) {
+    std::packaged_task<bool()> wrapped([this, task = std::move(task)]() {
+        const bool success = !std::exchange(failed_, false);
+        if (success) {
+            task();
+        }
+        return success;
+    });
+    tasks_.push_back(worker_.addTask(
+        std::move(wrapped), [this, onDone = std::move(onDone)](
+                                std::shared_future<bool> &future) {
+            tasks_.pop_front();
+            onDone(future.get());
+        }));
+}
+
+void BackgroundSaver::markDirty() {
+    const auto current = fcitx::now(CLOCK_MONOTONIC);
+    if (!dirtySince_) {
+        dirtySince_ = current;
+    }
+    // Keep delaying while user is still typing, but not forever.
+    timer_->setTime(
+        std::min(current + AutoSaveDelay, dirtySince_ + MaxAutoSaveDelay));
+    timer_->setOneShot();
+}
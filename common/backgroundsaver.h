@@ -0,0 +1,71 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _COMMON_BACKGROUNDSAVER_H_
+#define _COMMON_BACKGROUNDSAVER_H_
+
+#include "workerthread.h"
+#include <cstdint>
+#include <fcitx-utils/event.h>
+#include <fcitx-utils/eventdispatcher.h>
+#include <fcitx-utils/eventloopinterface.h>
+#include <functional>
+#include <list>
+#include <memory>
+#include <ostream>
+#include <string>
+
+/**
+ * Write user data files on a background thread.
+ *
+ * The caller is expected to take a snapshot of the data on the main thread,
+ * the writer then only touches the snapshot it owns. Writes are done in order
+ * by a single thread, and pending writes are still finished when the saver is
+ * destroyed.
+ *
+ * It also implements a debounced auto save, the callback is invoked once
+ * learning pauses for a while, or at most every MaxAutoSaveDelay if the
+ * learning never stops.
+ */
+class BackgroundSaver {
+public:
+    static constexpr uint64_t AutoSaveDelay = 30 * 1000000ULL;
+    static constexpr uint64_t MaxAutoSaveDelay = 5 * 60 * 1000000ULL;
+
+    using Writer = std::function<bool(std::ostream &)>;
+
+    BackgroundSaver(fcitx::EventLoop &loop, fcitx::EventDispatcher &dispatcher,
+                    std::function<void()> autoSave);
+    ~BackgroundSaver();
+
+    // Save file relative to PkgData with writer on the worker thread.
+    void save(std::string path, Writer writer);
+
+    // Run task on the worker thread, failure is treated like a failed save.
+    void run(std::function<bool()> task);
+
+    // Run task on the worker thread once all previous saves are done, but
+    // only if all of them succeeded. onDone is called on the main thread
+    // with the result, but not if the saver is being destroyed.
+    void afterSaved(std::function<void()> task,
+                    std::function<void(bool)> onDone);
+
+    // Request an auto save.
+    void markDirty();
+
+private:
+    std::function<void()> autoSave_;
+    std::unique_ptr<fcitx::EventSourceTime> timer_;
+    uint64_t dirtySince_ = 0;
+    // Only accessed by the worker thread.
+    bool failed_ = false;
+    std::list<std::unique_ptr<TaskToken>> tasks_;
+    // Must be after tasks_, so the tokens are still valid when the worker
+    // finishes the pending writes on destruction.
+    WorkerThread worker_;
+};
+
+#endif // _COMMON_BACKGROUNDSAVER_H_
@@ -0,0 +1,317 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "learningjournal.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fcitx-utils/fs.h>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/standardpaths.h>
+#include <fcitx-utils/stringutils.h>
+#include <fcitx-utils/unixfd.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <ios>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unistd.h>
+
+namespace {
+
+// First line of a journal file, it is not an operation.
+constexpr std::string_view GenerationHeader = "#generation";
+
+// One operation per line, fields are separated by tab.
+void appendEscaped(std::string &line, std::string_view field) {
+    for (char c : field) {
+        switch (c) {
+        case '\\':
+            line.append("\\\\");
+            break;
+        case '\t':
+            line.append("\\t");
+            break;
+        case '\n':
+            line.append("\\n");
+            break;
+        default:
+            line.push_back(c);
+            break;
+        }
+    }
+}
+
+LearningJournal::Operation parseLine(std::string_view line) {
+    LearningJournal::Operation op(1);
+    for (size_t i = 0; i < line.size(); i++) {
+        if (line[i] == '\t') {
+            op.emplace_back();
+        } else if (line[i] == '\\' && i + 1 < line.size()) {
+            i++;
+            switch (line[i]) {
+            case 't':
+                op.back().push_back('\t');
+                break;
+            case 'n':
+                op.back().push_back('\n');
+                break;
+            default:
+                op.back().push_back(line[i]);
+                break;
+            }
+        } else {
+            op.back().push_back(line[i]);
+        }
+    }
+    return op;
+}
+
+// Previous run may crash in the middle of a line, which is not a valid
+// operation.
+void dropIncompleteLine(const std::filesystem::path &path) {
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    const std::string content((std::istreambuf_iterator<char>(in)),
+                              std::istreambuf_iterator<char>());
+    if (content.empty() || content.back() == '\n') {
+        return;
+    }
+    const auto pos = content.rfind('\n');
+    std::error_code ec;
+    std::filesystem::resize_file(
+        path, pos == std::string::npos ? 0 : pos + 1, ec);
+}
+
+bool isGenerationHeader(const LearningJournal::Operation &op) {
+    return op.size() == 2 && op[0] == GenerationHeader;
+}
+
+uint64_t parseGeneration(const std::string &value) {
+    try {
+        return std::stoull(value);
+    } catch (const std::exception &) {
+        return 0;
+    }
+}
+
+// Return 0 if file doesn't exist, or is written before generations are
+// recorded.
+uint64_t readGeneration(const std::filesystem::path &path) {
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    std::string line;
+    if (!std::getline(in, line) || in.eof()) {
+        return 0;
+    }
+    const auto op = parseLine(line);
+    return isGenerationHeader(op) ? parseGeneration(op[1]) : 0;
+}
+
+std::filesystem::path compactedPath(const std::filesystem::path &path) {
+    auto result = path;
+    result += ".compacted";
+    return result;
+}
+
+} // namespace
+
+LearningJournal::LearningJournal(const std::filesystem::path &path)
+    : relativePath_(path),
+      path_(fcitx::StandardPaths::global().userDirectory(
+                fcitx::StandardPathsType::PkgData) /
+            path) {
+    {
+        std::ifstream in(compactedPath(path_), std::ios::in);
+        std::string value;
+        if (std::getline(in, value)) {
+            compacted_ = parseGeneration(value);
+        }
+    }
+    std::error_code ec;
+    if (std::filesystem::file_size(path_, ec) > 0 && !ec) {
+        generation_ = readGeneration(path_);
+    } else {
+        generation_ =
+            std::max(compacted_, readGeneration(rotatedPath())) + 1;
+    }
+    open();
+}
+
+void LearningJournal::open() {
+    fcitx::fs::makePath(path_.parent_path());
+    dropIncompleteLine(path_);
+    fd_ = fcitx::UnixFD::own(::open(path_.c_str(),
+                                    O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                                    0600));
+    if (!fd_.isValid()) {
+        FCITX_ERROR() << "Failed to open learning journal " << path_;
+        return;
+    }
+    std::error_code ec;
+    if (generation_ && std::filesystem::file_size(path_, ec) == 0 && !ec) {
+        const auto header = fcitx::stringutils::concat(
+            GenerationHeader, "\t", generation_, "\n");
+        if (fcitx::fs::safeWrite(fd_.fd(), header.data(), header.size()) !=
+            static_cast<ssize_t>(header.size())) {
+            FCITX_ERROR() << "Failed to write learning journal " << path_;
+        }
+    }
+}
+
+void LearningJournal::removeCompactedRotated() {
+    const auto rotated = rotatedPath();
+    if (const auto generation = readGeneration(rotated);
+        generation && generation <= compacted_) {
+        // Saved data contains them already, only the removal is missing.
+        std::error_code ec;
+        std::filesystem::remove(rotated, ec);
+    }
+}
+
+std::filesystem::path LearningJournal::rotatedPath() const {
+    auto path = path_;
+    path += ".old";
+    return path;
+}
+
+void LearningJournal::replay(
+    const std::function<void(const Operation &)> &callback) {
+    size_ = 0;
+    removeCompactedRotated();
+    for (const auto &path : {rotatedPath(), path_}) {
+        std::ifstream in(path, std::ios::in | std::ios::binary);
+        std::string line;
+        while (std::getline(in, line)) {
+            if (in.eof() || line.empty()) {
+                continue;
+            }
+            try {
+                auto op = parseLine(line);
+                if (isGenerationHeader(op)) {
+                    continue;
+                }
+                callback(op);
+                size_ += 1;
+            } catch (const std::exception &e) {
+                FCITX_ERROR() << "Failed to replay learning journal: "
+                              << e.what();
+            }
+        }
+    }
+    replayed_ = true;
+}
+
+void LearningJournal::append(const Operation &op) {
+    if (!fd_.isValid() || op.empty()) {
+        return;
+    }
+    std::string line;
+    for (const auto &field : op) {
+        if (!line.empty()) {
+            line.push_back('\t');
+        }
+        appendEscaped(line, field);
+    }
+    line.push_back('\n');
+    // A single write with O_APPEND, so the data is in the kernel once this
+    // returns, even if we crash right after.
+    if (fcitx::fs::safeWrite(fd_.fd(), line.data(), line.size()) !=
+        static_cast<ssize_t>(line.size())) {
+        FCITX_ERROR() << "Failed to write learning journal " << path_;
+        return;
+    }
+    size_ += 1;
+}
+
+bool LearningJournal::rotate() {
+    if (!replayed_ || rotating_ || !size_) {
+        return false;
+    }
+    fd_.reset();
+    removeCompactedRotated();
+    const auto rotated = rotatedPath();
+    std::error_code ec;
+    if (std::filesystem::exists(rotated, ec)) {
+        // Last compaction failed, keep the operations in order. They are
+        // compacted as the generation of the old file.
+        rotatedGeneration_ = readGeneration(rotated);
+        dropIncompleteLine(rotated);
+        std::ifstream in(path_, std::ios::in | std::ios::binary);
+        std::ofstream out(rotated,
+                          std::ios::out | std::ios::binary | std::ios::app);
+        out << in.rdbuf();
+        out.close();
+        if (out) {
+            std::filesystem::remove(path_, ec);
+        } else {
+            ec = std::make_error_code(std::errc::io_error);
+        }
+    } else {
+        std::filesystem::rename(path_, rotated, ec);
+        if (!ec) {
+            rotatedGeneration_ = generation_;
+        }
+    }
+    if (ec) {
+        FCITX_ERROR() << "Failed to rotate learning journal " << path_ << ": "
+                      << ec.message();
+        open();
+        return false;
+    }
+    generation_ = std::max({generation_, rotatedGeneration_, compacted_}) + 1;
+    open();
+    rotatedSize_ = size_;
+    size_ = 0;
+    rotating_ = true;
+    return true;
+}
+
+void LearningJournal::finishRotate(bool success) {
+    if (!success) {
+        // Operations are still there and will be compacted next time.
+        size_ += rotatedSize_;
+    } else {
+        compacted_ = std::max(compacted_, rotatedGeneration_);
+        rotatedGeneration_ = 0;
+    }
+    rotatedSize_ = 0;
+    rotating_ = false;
+}
+
+std::function<void()> LearningJournal::removeRotatedTask() const {
+    return [path = rotatedPath(), compacted = compactedPath(relativePath_),
+            generation = rotatedGeneration_]() {
+        // Written last, after the user data, so it's only there once the
+        // data contains the operations.
+        if (generation &&
+            !fcitx::StandardPaths::global().safeSave(
+                fcitx::StandardPathsType::PkgData, compacted,
+                [generation](int fd) {
+                    const auto value =
+                        fcitx::stringutils::concat(generation, "\n");
+                    return fcitx::fs::safeWrite(fd, value.data(),
+                                                value.size()) ==
+                           static_cast<ssize_t>(value.size());
+                })) {
+            // Old operations are replayed again, which is better than lost.
+            FCITX_ERROR() << "Failed to save " << compacted;
+            return;
+        }
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    };
+}
+
+std::function<bool()> LearningJournal::syncTask() const {
+    // Duplicate the fd, since it may be closed by rotate() in the meantime.
+    auto fd = std::make_shared<fcitx::UnixFD>(fd_.fd());
+    return [fd]() { return !fd->isValid() || ::fdatasync(fd->fd()) == 0; };
+}
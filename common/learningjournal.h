@@ -0,0 +1,78 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _COMMON_LEARNINGJOURNAL_H_
+#define _COMMON_LEARNINGJOURNAL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <fcitx-utils/unixfd.h>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Append-only log of user learning operations.
+ *
+ * Each operation is a list of strings, the first one being the name of the
+ * operation. The meaning is up to the engine, which replays them on top of
+ * the saved user data at startup.
+ *
+ * To compact the journal, rotate() moves the current operations aside, and the
+ * engine then saves its full user data. Once that is done, removeRotatedTask()
+ * drops the old operations. If it never happens, e.g. because of a crash, the
+ * old operations are replayed again on next startup.
+ *
+ * Operations are not safe to apply twice, so each journal file starts with a
+ * generation number. Before the old operations are removed, their generation
+ * is saved as compacted, and an old file of a compacted generation is never
+ * replayed, even if the removal doesn't happen.
+ */
+class LearningJournal {
+public:
+    using Operation = std::vector<std::string>;
+
+    // Path is relative to the user PkgData directory.
+    explicit LearningJournal(const std::filesystem::path &path);
+
+    void replay(const std::function<void(const Operation &)> &callback);
+    void append(const Operation &op);
+
+    // Number of operations that are not compacted yet.
+    size_t size() const { return size_; }
+
+    // Return false if there is nothing to compact, the operations are not
+    // replayed, or the previous compaction is not finished yet. Saved data
+    // without the operations must not replace them.
+    bool rotate();
+    void finishRotate(bool success);
+    // Return a task that can be run on any thread, it marks the rotated
+    // operations as compacted and removes them.
+    std::function<void()> removeRotatedTask() const;
+    std::function<bool()> syncTask() const;
+
+private:
+    void open();
+    void removeCompactedRotated();
+    std::filesystem::path rotatedPath() const;
+
+    // Relative to the user PkgData directory.
+    std::filesystem::path relativePath_;
+    std::filesystem::path path_;
+    fcitx::UnixFD fd_;
+    size_t size_ = 0;
+    size_t rotatedSize_ = 0;
+    bool rotating_ = false;
+    bool replayed_ = false;
+    // Generation of the current file, 0 if unknown.
+    uint64_t generation_ = 0;
+    uint64_t rotatedGeneration_ = 0;
+    // Generation that is saved as compacted.
+    uint64_t compacted_ = 0;
+};
+
+#endif // _COMMON_LEARNINGJOURNAL_H_
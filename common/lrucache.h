@@ -4,11 +4,14 @@
  * SPDX-License-Identifier: LGPL-2.1-or-later
  *
  */
-#ifndef _FCITX_LIBIME_LRU_H_
-#define _FCITX_LIBIME_LRU_H_
+#ifndef _COMMON_LRUCACHE_H_
+#define _COMMON_LRUCACHE_H_
 
+#include <cstddef>
+#include <iterator>
 #include <list>
 #include <unordered_map>
+#include <utility>
 
 template <typename K, typename V>
 class LRUCache {
@@ -67,6 +70,15 @@ public:
         order_.clear();
     }
 
+    // Visit all items from the least recently used one, without changing the
+    // order.
+    template <typename Callback>
+    void foreach(Callback callback) const {
+        for (auto iter = order_.rbegin(); iter != order_.rend(); ++iter) {
+            callback(*iter, dict_.find(*iter)->second.first);
+        }
+    }
+
 private:
     void evict() {
         // evict item from the end of most recently used list
@@ -96,4 +108,4 @@ private:
     size_t sz_;
 };
 
-#endif // _FCITX_LIBIME_LRU_H_
+#endif // _COMMON_LRUCACHE_H_
@@ -5,14 +5,22 @@
  *
  */
 #include "workerthread.h"
+#include <algorithm>
 #include <condition_variable>
+#include <cstddef>
 #include <fcitx-utils/eventdispatcher.h>
 #include <memory>
 #include <mutex>
 #include <thread>
 
-WorkerThread::WorkerThread(fcitx::EventDispatcher &dispatcher)
-    : dispatcher_(dispatcher), thread_(&WorkerThread::runThread, this) {}
+WorkerThread::WorkerThread(fcitx::EventDispatcher &dispatcher, size_t threads)
+    : dispatcher_(dispatcher) {
+    threads = std::max<size_t>(threads, 1);
+    threads_.reserve(threads);
+    for (size_t i = 0; i < threads; i++) {
+        threads_.emplace_back(&WorkerThread::runThread, this);
+    }
+}
 
 WorkerThread::~WorkerThread() {
     // Unlike other thread, there is no need to use a event loop  since there is
@@ -20,13 +28,20 @@ WorkerThread::~WorkerThread() {
     {
         std::lock_guard<std::mutex> lock(mutex_);
         exit_ = true;
-        condition_.notify_one();
+        condition_.notify_all();
     }
-    if (thread_.joinable()) {
-        thread_.join();
+    for (auto &thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
     }
 }
 
+size_t WorkerThread::defaultThreadCount() {
+    // hardware_concurrency may return 0 if it is unknown.
+    return std::clamp<size_t>(std::thread::hardware_concurrency(), 1, 4);
+}
+
 std::unique_ptr<TaskToken>
 WorkerThread::addTaskImpl(std::function<void()> task,
                           std::function<void()> onDone) {
@@ -47,13 +62,19 @@ void WorkerThread::run() {
         {
             std::unique_lock lock(mutex_);
             condition_.wait(lock, [this] { return exit_ || !queue_.empty(); });
-            if (exit_) {
+            // Finish the pending tasks before exit, the ones that are not
+            // wanted anymore are skipped below.
+            if (queue_.empty()) {
                 break;
             }
 
             task = std::move(queue_.front());
             queue_.pop();
         }
+        // The token is already gone, nobody cares about the result.
+        if (!task.context.isValid()) {
+            continue;
+        }
         // Run the actual task.
         task.task();
         dispatcher_.scheduleWithContext(std::move(task.context),
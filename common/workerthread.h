@@ -4,10 +4,11 @@
  * SPDX-License-Identifier: LGPL-2.1-or-later
  *
  */
-#ifndef _PINYIN_WORKERTHREAD_H_
-#define _PINYIN_WORKERTHREAD_H_
+#ifndef _COMMON_WORKERTHREAD_H_
+#define _COMMON_WORKERTHREAD_H_
 
 #include <condition_variable>
+#include <cstddef>
 #include <fcitx-utils/eventdispatcher.h>
 #include <fcitx-utils/macros.h>
 #include <fcitx-utils/trackableobject.h>
@@ -17,14 +18,26 @@
 #include <memory>
 #include <mutex>
 #include <queue>
+#include <thread>
+#include <vector>
 
 class TaskToken : public fcitx::TrackableObject<TaskToken> {};
 
+/**
+ * A small pool of worker threads.
+ *
+ * Tasks may run concurrently and finish in any order, but the callback of
+ * each task is always invoked on the thread that owns the dispatcher. Pending
+ * tasks are still run on destruction, unless their token is already gone.
+ */
 class WorkerThread {
 public:
-    WorkerThread(fcitx::EventDispatcher &dispatcher);
+    WorkerThread(fcitx::EventDispatcher &dispatcher,
+                 size_t threads = defaultThreadCount());
     ~WorkerThread();
 
+    static size_t defaultThreadCount();
+
     template <typename Ret, typename OnDone>
     FCITX_NODISCARD std::unique_ptr<TaskToken>
     addTask(std::packaged_task<Ret()> task, OnDone onDone) {
@@ -61,9 +74,9 @@ private:
     bool exit_ = false;
     std::condition_variable condition_;
 
-    // Must be the last member, since we did not use a smart pointer to wrap it.
-    // The thread will be started right away at the end of constructor.
-    std::thread thread_;
+    // Must be the last member, since threads will be started right away at
+    // the end of constructor.
+    std::vector<std::thread> threads_;
 };
 
 #endif
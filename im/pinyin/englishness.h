@@ -0,0 +1,90 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _PINYIN_ENGLISHNESS_H_
+#define _PINYIN_ENGLISHNESS_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <fcitx-utils/charutils.h>
+#include <string_view>
+#include <tuple>
+
+namespace fcitx {
+
+/**
+ * Guess how likely the raw pinyin preedit is an English word.
+ *
+ * Returns whether the input has upper case letter, and the number of spell
+ * hints to show, 0 means the input looks like pinyin.
+ */
+inline std::tuple<bool, int> englishNess(std::string_view input, bool sp) {
+    constexpr int fullWeight = -2;
+    constexpr int shortWeight = 3;
+    constexpr int invalidWeight = 6;
+    constexpr int defaultWeight = shortWeight;
+    int weight = 0;
+    size_t count = 0;
+    bool hasUpper = false;
+    bool isPinyin = false;
+
+    // Syllables are separated by space, empty ones are skipped.
+    size_t start = 0;
+    while (start < input.size()) {
+        auto end = input.find(' ', start);
+        if (end == std::string_view::npos) {
+            end = input.size();
+        }
+        const auto py = input.substr(start, end - start);
+        start = end + 1;
+        if (py.empty()) {
+            continue;
+        }
+        count += 1;
+        hasUpper = hasUpper || std::ranges::any_of(py, charutils::isupper);
+        if (hasUpper || isPinyin) {
+            continue;
+        }
+        if (sp) {
+            if (py.size() == 2) {
+                weight += fullWeight / 2;
+            } else {
+                weight += invalidWeight;
+            }
+        } else {
+            if (py == "ng") {
+                weight += fullWeight;
+            } else {
+                auto firstChr = py[0];
+                if (firstChr == '\'') {
+                    isPinyin = true;
+                } else if (firstChr == 'i' || firstChr == 'u' ||
+                           firstChr == 'v') {
+                    weight += invalidWeight;
+                } else if (py.size() <= 2) {
+                    weight += shortWeight;
+                } else if (py.find_first_of("aeiou") !=
+                           std::string_view::npos) {
+                    weight += fullWeight;
+                } else {
+                    weight += defaultWeight;
+                }
+            }
+        }
+    }
+
+    if (hasUpper) {
+        return {true, std::max<size_t>(1, (invalidWeight * count + 7) / 10)};
+    }
+    if (isPinyin || weight < 0) {
+        return {false, 0};
+    }
+    return {false, (weight + 7) / 10};
+}
+
+} // namespace fcitx
+
+#endif // _PINYIN_ENGLISHNESS_H_
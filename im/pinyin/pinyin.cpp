@@ -7,17 +7,20 @@
 
 #include "pinyin.h"
 
+#include "../../common/backgroundsaver.h"
+#include "../../common/learningjournal.h"
+#include "../../common/workerthread.h"
 // Use relative path so we don't need import export target.
 // We want to keep cloudpinyin logic but don't call it.
 #include "../../modules/cloudpinyin/cloudpinyin_public.h"
 #include "config.h"
 #include "customphrase.h"
+#include "englishness.h"
 #include "notifications_public.h"
 #include "pinyincandidate.h"
 #include "pinyinhelper_public.h"
 #include "punctuation_public.h"
 #include "spell_public.h"
-#include "workerthread.h"
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
@@ -61,6 +64,7 @@
 #include <fstream>
 #include <functional>
 #include <future>
+#include <initializer_list>
 #include <ios>
 #include <istream>
 #include <iterator>
@@ -83,7 +87,7 @@
 #include <ostream>
 #include <quickphrase_public.h>
 #include <ranges>
-#include <regex>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
@@ -106,6 +110,27 @@ FCITX_DEFINE_LOG_CATEGORY(pinyin, "pinyin");
 #define PINYIN_DEBUG() FCITX_LOGC(pinyin, Debug)
 #define PINYIN_ERROR() FCITX_LOGC(pinyin, Error)
 
+#ifdef FCITX_HAS_LUA
+// Lua array is returned as Length and 0 based index.
+std::vector<std::string> luaStringList(const RawConfig &config) {
+    std::vector<std::string> result;
+    const auto *length = config.valueByPath("Length");
+    try {
+        if (length) {
+            auto n = std::stoi(*length);
+            for (int i = 0; i < n; i++) {
+                const auto *candidate = config.valueByPath(std::to_string(i));
+                if (candidate && !candidate->empty()) {
+                    result.push_back(*candidate);
+                }
+            }
+        }
+    } catch (...) {
+    }
+    return result;
+}
+#endif
+
 template <typename T>
 std::unique_ptr<CandidateList>
 predictCandidateList(PinyinEngine *engine, const std::vector<T> &words) {
@@ -139,52 +164,6 @@ predictCandidateList(PinyinEngine *engine, const std::vector<T> &words) {
     return candidateList;
 }
 
-std::tuple<bool, int> englishNess(const std::string &input, bool sp) {
-    const auto pys = stringutils::split(input, " ");
-    constexpr int fullWeight = -2;
-    constexpr int shortWeight = 3;
-    constexpr int invalidWeight = 6;
-    constexpr int defaultWeight = shortWeight;
-    int weight = 0;
-    if (std::any_of(input.begin(), input.end(), charutils::isupper)) {
-        return {true,
-                std::max<size_t>(1, (invalidWeight * pys.size() + 7) / 10)};
-    }
-
-    for (const auto &py : pys) {
-        if (sp) {
-            if (py.size() == 2) {
-                weight += fullWeight / 2;
-            } else {
-                weight += invalidWeight;
-            }
-        } else {
-            if (py == "ng") {
-                weight += fullWeight;
-            } else {
-                auto firstChr = py[0];
-                if (firstChr == '\'') {
-                    return {false, 0};
-                }
-                if (firstChr == 'i' || firstChr == 'u' || firstChr == 'v') {
-                    weight += invalidWeight;
-                } else if (py.size() <= 2) {
-                    weight += shortWeight;
-                } else if (py.find_first_of("aeiou") != std::string::npos) {
-                    weight += fullWeight;
-                } else {
-                    weight += defaultWeight;
-                }
-            }
-        }
-    }
-
-    if (weight < 0) {
-        return {false, 0};
-    }
-    return {false, (weight + 7) / 10};
-}
-
 bool isStroke(const std::string &input) {
     static const std::unordered_set<char> py{'h', 'p', 's', 'z', 'n'};
     return std::all_of(input.begin(), input.end(),
@@ -216,6 +195,21 @@ std::string getEncodedPinyin(const libime::SentenceResult &result) {
     return encodedPinyin;
 }
 
+// Fields are prefixed with their length, since LM state and encoded pinyin are
+// binary.
+std::string predictionKey(std::initializer_list<std::string_view> fields,
+                          const std::vector<std::string> &words) {
+    std::string key;
+    auto append = [&key](std::string_view field) {
+        key.append(std::to_string(field.size()));
+        key.push_back(':');
+        key.append(field);
+    };
+    std::ranges::for_each(fields, append);
+    std::ranges::for_each(words, append);
+    return key;
+}
+
 } // namespace
 
 PinyinState::PinyinState(PinyinEngine *engine) : context_(engine->ime()) {
@@ -226,6 +220,7 @@ void PinyinEngine::initPredict(InputContext *inputContext) {
     auto *state = inputContext->propertyFor(&factory_);
     // clear state no matter what.
     state->predictWords_.reset();
+    state->predictTask_.reset();
     auto &context = state->context_;
     auto lmState = context.state();
     auto selected = context.selectedWords();
@@ -242,18 +237,32 @@ void PinyinEngine::initPredict(InputContext *inputContext) {
     const auto selectPinyin = context.selectedWordsWithPinyin();
     const std::string lastEncodedPinyin =
         !selectPinyin.empty() ? selectPinyin.back().second : std::string();
-
-    auto words = prediction_.predict(lmState, selected, lastEncodedPinyin,
-                                     *config_.predictionSize);
-    if (auto candidateList = predictCandidateList(this, words)) {
-        auto &inputPanel = inputContext->inputPanel();
-        state->predictWords_ = std::move(selected);
-        inputPanel.setCandidateList(std::move(candidateList));
-    } else {
-        return;
-    }
-    inputContext->updatePreedit();
-    inputContext->updateUserInterface(UserInterfaceComponent::InputPanel);
+    const int size = *config_.predictionSize;
+
+    auto key = predictionKey(
+        {"init", std::to_string(size),
+         std::string_view(lmState.data(), lmState.size()), lastEncodedPinyin},
+        selected);
+    state->predictTask_ = predictor_.predict(
+        std::move(key),
+        [this, lmState, selected, lastEncodedPinyin, size]() {
+            return prediction_.predict(lmState, selected, lastEncodedPinyin,
+                                       size);
+        },
+        [this, inputContext,
+         selected](const PinyinPredictionResult &words) mutable {
+            auto candidateList = predictCandidateList(this, words);
+            if (!candidateList) {
+                return;
+            }
+            auto *state = inputContext->propertyFor(&factory_);
+            state->predictWords_ = std::move(selected);
+            inputContext->inputPanel().setCandidateList(
+                std::move(candidateList));
+            inputContext->updatePreedit();
+            inputContext->updateUserInterface(
+                UserInterfaceComponent::InputPanel);
+        });
 }
 
 void PinyinEngine::updatePredict(InputContext *inputContext) {
@@ -264,43 +273,106 @@ void PinyinEngine::updatePredict(InputContext *inputContext) {
     if (*config_.keepCurrentContext) {
         state->context_.setContextWords(*state->predictWords_);
     }
-    auto words =
-        prediction_.predict(*state->predictWords_, *config_.predictionSize);
-    if (auto candidateList = predictCandidateList(this, words)) {
-        auto &inputPanel = inputContext->inputPanel();
-        inputPanel.setCandidateList(std::move(candidateList));
-    } else {
-        // Clear if we can't do predict.
-        // This help other code to detect whether we are in predict.
-        state->predictWords_.reset();
+    const int size = *config_.predictionSize;
+    state->predictTask_ = predictor_.predict(
+        predictionKey({"update", std::to_string(size)}, *state->predictWords_),
+        [this, words = *state->predictWords_, size]() {
+            PinyinPredictionResult result;
+            for (auto &word : prediction_.predict(words, size)) {
+                result.emplace_back(std::move(word),
+                                    libime::PinyinPredictionSource::Model);
+            }
+            return result;
+        },
+        [this, inputContext](const PinyinPredictionResult &words) {
+            if (auto candidateList = predictCandidateList(this, words)) {
+                auto &inputPanel = inputContext->inputPanel();
+                inputPanel.setCandidateList(std::move(candidateList));
+            } else {
+                // Clear if we can't do predict.
+                // This help other code to detect whether we are in predict.
+                inputContext->propertyFor(&factory_)->predictWords_.reset();
+            }
+            inputContext->updatePreedit();
+            inputContext->updateUserInterface(
+                UserInterfaceComponent::InputPanel);
+        });
+    if (state->predictTask_) {
+        // Show the reset panel until the result is ready.
+        inputContext->updatePreedit();
+        inputContext->updateUserInterface(UserInterfaceComponent::InputPanel);
     }
-    inputContext->updatePreedit();
-    inputContext->updateUserInterface(UserInterfaceComponent::InputPanel);
 }
 
 #ifdef FCITX_HAS_LUA
+std::vector<std::vector<std::string>>
+PinyinEngine::luaCandidateTrigger(InputContext *ic,
+                                  const std::vector<std::string> &candidates) {
+    auto *state = ic->propertyFor(&factory_);
+    auto &cache = state->luaTriggerCache_;
+    const auto &input = state->context_.userInput();
+    if ((!input.starts_with(state->luaTriggerInput_) &&
+         !state->luaTriggerInput_.starts_with(input)) ||
+        cache.size() >= LuaTriggerCacheSize) {
+        cache.clear();
+    }
+    state->luaTriggerInput_ = input;
+
+    std::vector<std::vector<std::string>> result(candidates.size());
+    std::vector<size_t> missing;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (!cache.contains(candidates[i])) {
+            missing.push_back(i);
+        }
+    }
+    if (missing.empty()) {
+        return result;
+    }
+
+    bool done = false;
+    if (luaBatchTrigger_) {
+        RawConfig arg;
+        arg.setValueByPath("Length", std::to_string(missing.size()));
+        for (size_t i = 0; i < missing.size(); i++) {
+            arg.setValueByPath(std::to_string(i), candidates[missing[i]]);
+        }
+        auto ret = imeapi()->call<ILuaAddon::invokeLuaFunction>(
+            ic, "pinyin_candidate_trigger_batch", arg);
+        if (ret.valueByPath("Length")) {
+            for (size_t i = 0; i < missing.size(); i++) {
+                if (const auto sub = ret.get(std::to_string(i))) {
+                    result[missing[i]] = luaStringList(*sub);
+                }
+            }
+            done = true;
+        } else {
+            // pinyin.lua catches errors of each trigger, so this means the
+            // function is missing. Try again after the next reload.
+            PINYIN_DEBUG() << "Batched lua candidate trigger is not available.";
+            luaBatchTrigger_ = false;
+        }
+    }
+    for (auto i : missing) {
+        if (!done) {
+            result[i] = luaCandidateTrigger(ic, candidates[i]);
+        }
+        // Triggers may depend on something else than the candidate, e.g. the
+        // current time, so only remember candidates without any result.
+        if (result[i].empty()) {
+            cache.insert(candidates[i]);
+        }
+    }
+    return result;
+}
+
 std::vector<std::string>
 PinyinEngine::luaCandidateTrigger(InputContext *ic,
                                   const std::string &candidateString) {
-    std::vector<std::string> result;
     RawConfig arg;
     arg.setValue(candidateString);
     auto ret = imeapi()->call<ILuaAddon::invokeLuaFunction>(
         ic, "candidateTrigger", arg);
-    const auto *length = ret.valueByPath("Length");
-    try {
-        if (length) {
-            auto n = std::stoi(*length);
-            for (int i = 0; i < n; i++) {
-                const auto *candidate = ret.valueByPath(std::to_string(i));
-                if (candidate && !candidate->empty()) {
-                    result.push_back(*candidate);
-                }
-            }
-        }
-    } catch (...) {
-    }
-    return result;
+    return luaStringList(ret);
 }
 #endif
 
@@ -422,9 +494,24 @@ void PinyinEngine::updateUI(InputContext *inputContext) {
     const auto &context = state->context_;
     if (context.selected()) {
         auto sentence = context.sentence();
-        if (!inputContext->capabilityFlags().testAny(
-                CapabilityFlag::PasswordOrSensitive)) {
-            state->context_.learn();
+        // Don't learn before user data is loaded, it would be overwritten.
+        if (ready_ && !inputContext->capabilityFlags().testAny(
+                          CapabilityFlag::PasswordOrSensitive)) {
+            LearningJournal::Operation op{"learn"};
+            for (const auto &[word, encodedPinyin] :
+                 context.selectedWordsWithPinyin()) {
+                op.push_back(word);
+                op.push_back(
+                    encodedPinyin.empty()
+                        ? std::string()
+                        : libime::PinyinEncoder::decodeFullPinyin(
+                              encodedPinyin));
+            }
+            {
+                auto lock = predictor_.lock();
+                state->context_.learn();
+            }
+            appendJournal(std::move(op));
         }
         inputContext->commitString(sentence);
         inputContext->updatePreedit();
@@ -443,7 +530,7 @@ void PinyinEngine::updateUI(InputContext *inputContext) {
         auto &inputPanel = inputContext->inputPanel();
         // Update candidate
         const auto &pinyinCandidates = context.candidatesToCursor();
-        if (pinyinCandidates.empty()) {
+        if (pinyinCandidates.empty() && ready_) {
             break;
         }
 
@@ -470,6 +557,13 @@ void PinyinEngine::updateUI(InputContext *inputContext) {
         // Since symbol is by default, add some extra size for reservation.
         candidates.reserve(pinyinCandidates.size() + (*config_.pageSize * 2));
         std::unordered_set<std::string> customCandidateSet;
+        // Dictionaries are still being loaded, offer the raw input so user
+        // can still type something.
+        if (!ready_ && !pyBeforeCursor.empty()) {
+            customCandidateSet.insert(pyBeforeCursor);
+            candidates.push_back(std::make_unique<SpellCandidateWord>(
+                this, pyBeforeCursor, pyBeforeCursor.size(), 0));
+        }
         /// Create custom phrase candidate {{{
         do {
             const auto *results = customPhrase_.lookup(pyBeforeCursor);
@@ -500,10 +594,17 @@ void PinyinEngine::updateUI(InputContext *inputContext) {
 
         /// Create cloud candidate. {{{
         std::optional<decltype(candidates)::iterator> cloud;
-        if (*config_.cloudPinyinEnabled && cloudpinyin() &&
-            !inputContext->capabilityFlags().testAny(
-                CapabilityFlag::PasswordOrSensitive) &&
-            fullResult) {
+        const bool cloudAllowed = *config_.cloudPinyinEnabled &&
+                                  cloudpinyin() &&
+                                  !inputContext->capabilityFlags().testAny(
+                                      CapabilityFlag::PasswordOrSensitive);
+        if (cloudAllowed && !fullResult && !context.useShuangpin()) {
+            // Cursor is moved back, the whole input is likely to be requested
+            // once it's moved to the end again.
+            cloudpinyin()->call<ICloudPinyin::prefetch>(
+                context.userInput().substr(selectedLength), inputContext);
+        }
+        if (cloudAllowed && fullResult) {
             using namespace std::placeholders;
             auto fullPinyin = context.useShuangpin()
                                   ? context.candidateFullPinyin(0)
@@ -515,6 +616,7 @@ void PinyinEngine::updateUI(InputContext *inputContext) {
                     cloudPinyinSelected(ic, selected, word);
                 },
                 *config_.cloudPinyinIndex - 1);
+            const auto *cloudCand = cand.get();
             if (!cand->filled() ||
                 (!cand->word().empty() &&
                  !customCandidateSet.contains(cand->word()) &&
@@ -523,26 +625,32 @@ void PinyinEngine::updateUI(InputContext *inputContext) {
                 candidates.push_back(std::move(cand));
                 cloud = std::prev(candidates.end());
             }
+            // Result is already known, show the rest of the top candidates
+            // right after it, even if the first one is a duplicate.
+            const auto &results = cloudCand->candidates();
+            for (size_t i = 1; i < results.size(); i++) {
+                if (customCandidateSet.contains(results[i]) ||
+                    context.candidatesToCursorSet().contains(results[i])) {
+                    continue;
+                }
+                customCandidateSet.insert(results[i]);
+                candidates.push_back(cloudCand->extraWord(results[i]));
+            }
         }
         /// }}}
 
         /// Create spell candidate {{{
-        auto [parsedPy, parsedPyCursor] = state->context_.preeditWithCursor(
-            libime::PinyinPreeditMode::RawText);
         if (*config_.spellEnabled && spell() &&
-            parsedPyCursor >= selectedSentence.size() &&
             selectedLength <= context.cursor()) {
+            const auto [parsedPy, parsedPyCursor] =
+                state->context_.preeditWithCursor(
+                    libime::PinyinPreeditMode::RawText);
             auto [hasUpper, engNess] =
-                englishNess(parsedPy, context.useShuangpin());
+                parsedPyCursor >= selectedSentence.size()
+                    ? englishNess(parsedPy, context.useShuangpin())
+                    : std::tuple<bool, int>{false, 0};
             if (engNess) {
-                parsedPyCursor -= selectedSentence.length();
-                parsedPy = parsedPy.substr(
-                    selectedSentence.size(),
-                    parsedPyCursor > selectedSentence.length()
-                        ? parsedPyCursor - selectedSentence.length()
-                        : std::string::npos);
-                auto results = spell()->call<ISpell::hintWithProvider>(
-                    "en", SpellProvider::Custom, pyBeforeCursor, engNess);
+                auto results = spellHint(pyBeforeCursor, engNess);
 
                 // Our hint doesn't work well with mixed case, so, always put a
                 // word as is.
@@ -584,10 +692,15 @@ void PinyinEngine::updateUI(InputContext *inputContext) {
                 strokeCandsPos = *config_.pageSize - 1;
             }
             for (auto &result : results) {
-                utf8::getChar(result.first);
-                auto py = pinyinhelper()->call<IPinyinHelper::lookup>(
-                    utf8::getChar(result.first));
-                auto pystr = stringutils::join(py, " ");
+                std::string pystr;
+                pinyinhelper()->call<IPinyinHelper::forEachPinyin>(
+                    utf8::getChar(result.first),
+                    [&pystr](std::string_view pinyin, std::string_view, int) {
+                        if (!pystr.empty()) {
+                            pystr.push_back(' ');
+                        }
+                        pystr.append(pinyin);
+                    });
                 candidates.push_back(std::make_unique<StrokeCandidateWord>(
                     this, result.first, pystr, context.userInput().size(),
                     strokeCandsPos++));
@@ -605,7 +718,7 @@ void PinyinEngine::updateUI(InputContext *inputContext) {
         // Save the middle point for inplace_merge.
         const size_t middle = candidates.size();
 
-        for (size_t idx = 0; idx < pinyinCandidates.size(); ++idx) {
+        for (size_t idx = 0; ready_ && idx < pinyinCandidates.size(); ++idx) {
             const auto &candidate = pinyinCandidates[idx];
             auto candidateString = candidate.toString();
             if (customCandidateSet.contains(candidateString)) {
@@ -619,6 +732,30 @@ void PinyinEngine::updateUI(InputContext *inputContext) {
                                    std::next(candidates.begin(), middle),
                                    candidateCompare);
 
+#ifdef FCITX_HAS_LUA
+        // Only trigger lua for top N candidates to avoid too much overhead,
+        // and do it with a single call.
+        std::vector<int> luaTriggerIndex(candidates.size(), -1);
+        std::vector<std::vector<std::string>> luaTriggerResult;
+        if (imeapi()) {
+            std::vector<std::string> luaTriggerCandidates;
+            const auto topN = std::max(*config_.nbest, *config_.pageSize);
+            for (size_t i = 0; i < candidates.size(); i++) {
+                if (candidates[i]->order() < topN) {
+                    luaTriggerIndex[i] =
+                        static_cast<int>(luaTriggerCandidates.size());
+                    luaTriggerCandidates.push_back(
+                        candidates[i]->text().toString());
+                }
+            }
+            if (!luaTriggerCandidates.empty()) {
+                luaTriggerResult =
+                    luaCandidateTrigger(inputContext, luaTriggerCandidates);
+            }
+        }
+        size_t index = 0;
+#endif
+
         // Apply the candidate to candidate generation.
         for (auto &candidatePtr : candidates) {
             // Candidate pointer shall still valid here.
@@ -627,13 +764,11 @@ void PinyinEngine::updateUI(InputContext *inputContext) {
 
             std::vector<std::string> luaExtraCandidates;
 #ifdef FCITX_HAS_LUA
-            // Only trigger lua for top N candidates to avoid too much overhead.
-            if (candidate->order() <
-                    std::max(*config_.nbest, *config_.pageSize) &&
-                imeapi()) {
+            if (luaTriggerIndex[index] >= 0) {
                 luaExtraCandidates =
-                    luaCandidateTrigger(inputContext, candidateString);
+                    std::move(luaTriggerResult[luaTriggerIndex[index]]);
             }
+            index++;
 #endif
 
             // use candidateString before it is moved.
@@ -677,6 +812,20 @@ void PinyinEngine::updateUI(InputContext *inputContext) {
     inputContext->updateUserInterface(UserInterfaceComponent::InputPanel);
 }
 
+std::vector<std::string> PinyinEngine::spellHint(const std::string &word,
+                                                int limit) {
+    // Same input shows up again on backspace, cursor move or cloud pinyin
+    // update, skip the call into spell for it.
+    auto key = stringutils::concat(std::to_string(limit), "\n", word);
+    if (const auto *results = spellHintCache_.find(key)) {
+        return *results;
+    }
+    auto results = spell()->call<ISpell::hintWithProvider>(
+        "en", SpellProvider::Custom, word, limit);
+    spellHintCache_.insert(key, results);
+    return results;
+}
+
 std::string PinyinEngine::evaluateCustomPhrase(InputContext *inputContext,
                                                std::string_view key) {
     FCITX_UNUSED(inputContext);
@@ -701,60 +850,21 @@ std::string PinyinEngine::evaluateCustomPhrase(InputContext *inputContext,
 PinyinEngine::PinyinEngine(Instance *instance)
     : instance_(instance),
       factory_([this](InputContext &) { return new PinyinState(this); }),
-      worker_(instance->eventDispatcher()) {
+      worker_(instance->eventDispatcher()),
+      predictor_(instance->eventDispatcher()),
+      journal_("pinyin/user.journal"),
+      saver_(instance->eventLoop(), instance->eventDispatcher(),
+             [this]() { autoSave(); }) {
     ime_ = std::make_unique<libime::PinyinIME>(
         std::make_unique<libime::PinyinDictionary>(),
         std::make_unique<libime::UserLanguageModel>(
             libime::DefaultLanguageModelResolver::instance()
                 .languageModelFileForLanguage("zh_CN")));
 
-    const auto &standardPath = StandardPaths::global();
-    auto systemDictFile =
-        standardPath.open(StandardPathsType::Data, "libime/sc.dict");
-    if (systemDictFile.isValid()) {
-        IFDStreamBuf buffer(systemDictFile.fd());
-        std::istream in(&buffer);
-        ime_->dict()->load(libime::PinyinDictionary::SystemDict, in,
-                           libime::PinyinDictFormat::Binary);
-    } else {
-        ime_->dict()->load(libime::PinyinDictionary::SystemDict,
-                           LIBIME_INSTALL_PKGDATADIR "/sc.dict",
-                           libime::PinyinDictFormat::Binary);
-    }
     prediction_.setUserLanguageModel(ime_->model());
     prediction_.setPinyinDictionary(ime_->dict());
 
-    do {
-        auto file =
-            standardPath.open(StandardPathsType::PkgData, "pinyin/user.dict");
-
-        if (!file.isValid()) {
-            break;
-        }
-
-        try {
-            IFDStreamBuf buffer(file.fd());
-            std::istream in(&buffer);
-            ime_->dict()->load(libime::PinyinDictionary::UserDict, in,
-                               libime::PinyinDictFormat::Binary);
-        } catch (const std::exception &e) {
-            PINYIN_ERROR() << "Failed to load pinyin dict: " << e.what();
-        }
-    } while (0);
-    do {
-        auto file =
-            standardPath.open(StandardPathsType::PkgData, "pinyin/user.history",
-                              StandardPathsMode::User);
-
-        try {
-            IFDStreamBuf buffer(file.fd());
-            std::istream in(&buffer);
-            ime_->model()->load(in);
-        } catch (const std::exception &e) {
-            PINYIN_ERROR() << "Failed to load pinyin history: " << e.what();
-        }
-    } while (0);
-
+    loadSystemDict();
     ime_->setScoreFilter(1);
     loadBuiltInDict();
     reloadConfig();
@@ -825,6 +935,8 @@ PinyinEngine::PinyinEngine(Instance *instance)
             configPtr->cloudPinyinEnabled.annotation().setHidden(
                 !hasCloudPinyin);
             configPtr->cloudPinyinIndex.annotation().setHidden(!hasCloudPinyin);
+            configPtr->cloudPinyinCandidates.annotation().setHidden(
+                !hasCloudPinyin);
             configPtr->cloudPinyinAnimation.annotation().setHidden(
                 !hasCloudPinyin);
             configPtr->keepCloudPinyinPlaceHolder.annotation().setHidden(
@@ -857,6 +969,7 @@ void PinyinEngine::loadDict(const std::string &fullPath,
     if (fullPath.empty()) {
         return;
     }
+    predictor_.invalidate();
     ime_->dict()->addEmptyDict();
     PINYIN_DEBUG() << "Loading pinyin dict " << fullPath;
     std::packaged_task<libime::PinyinDictionary::TrieType()> task([fullPath]() {
@@ -865,6 +978,8 @@ void PinyinEngine::loadDict(const std::string &fullPath,
             in, libime::PinyinDictFormat::Binary);
         return trie;
     });
+    // Dictionaries may be loaded in parallel and finish in any order, the slot
+    // is reserved above so the final order is always the same.
     taskTokens.push_back(worker_.addTask(
         std::move(task),
         [this, index = ime_->dict()->dictSize() - 1, fullPath](
@@ -872,6 +987,7 @@ void PinyinEngine::loadDict(const std::string &fullPath,
             try {
                 PINYIN_DEBUG()
                     << "Load pinyin dict " << fullPath << " finished.";
+                predictor_.invalidate();
                 ime_->dict()->setTrie(index, future.get());
             } catch (const std::exception &e) {
                 PINYIN_ERROR() << "Failed to load pinyin dict " << fullPath
@@ -880,6 +996,142 @@ void PinyinEngine::loadDict(const std::string &fullPath,
         }));
 }
 
+void PinyinEngine::loadSystemDict() {
+    // Loading sc.dict, user.dict and user.history is the most expensive part
+    // of the startup. Do it on the worker and only keep the file lookup here,
+    // so the engine can accept input right away.
+    struct SystemData {
+        std::optional<libime::PinyinDictionary::TrieType> systemDict;
+        std::optional<libime::PinyinDictionary::TrieType> userDict;
+        std::string history;
+        // User dict or history exists but can't be read.
+        bool userDataFailed = false;
+    };
+
+    const auto &standardPath = StandardPaths::global();
+    auto systemDictFile =
+        standardPath.open(StandardPathsType::Data, "libime/sc.dict");
+    if (!systemDictFile.isValid()) {
+        systemDictFile = standardPath.open(
+            StandardPathsType::Data, LIBIME_INSTALL_PKGDATADIR "/sc.dict");
+    }
+    auto userDictFile =
+        standardPath.open(StandardPathsType::PkgData, "pinyin/user.dict");
+    auto historyFile =
+        standardPath.open(StandardPathsType::PkgData, "pinyin/user.history",
+                          StandardPathsMode::User);
+
+    // Each file is loaded on its own, user data is still needed without
+    // sc.dict, or it would be overwritten by the next save.
+    std::packaged_task<std::shared_ptr<SystemData>()> task(
+        [systemDictFile = std::move(systemDictFile),
+         userDictFile = std::move(userDictFile),
+         historyFile = std::move(historyFile)]() {
+            auto data = std::make_shared<SystemData>();
+            if (systemDictFile.isValid()) {
+                try {
+                    IFDStreamBuf buffer(systemDictFile.fd());
+                    std::istream in(&buffer);
+                    data->systemDict = libime::PinyinDictionary::load(
+                        in, libime::PinyinDictFormat::Binary);
+                } catch (const std::exception &e) {
+                    PINYIN_ERROR()
+                        << "Failed to load pinyin system dict: " << e.what();
+                }
+            } else {
+                PINYIN_ERROR() << "Failed to open pinyin system dict.";
+            }
+            if (userDictFile.isValid()) {
+                try {
+                    IFDStreamBuf buffer(userDictFile.fd());
+                    std::istream in(&buffer);
+                    data->userDict = libime::PinyinDictionary::load(
+                        in, libime::PinyinDictFormat::Binary);
+                } catch (const std::exception &e) {
+                    PINYIN_ERROR()
+                        << "Failed to load pinyin dict: " << e.what();
+                    data->userDataFailed = true;
+                }
+            }
+            if (historyFile.isValid()) {
+                IFDStreamBuf buffer(historyFile.fd());
+                std::istream in(&buffer);
+                data->history.assign(std::istreambuf_iterator<char>(in),
+                                    std::istreambuf_iterator<char>());
+                if (in.bad()) {
+                    data->userDataFailed = true;
+                }
+            }
+            return data;
+        });
+    PINYIN_DEBUG() << "Loading pinyin system dict.";
+    persistentTask_.push_back(worker_.addTask(
+        std::move(task),
+        [this](std::shared_future<std::shared_ptr<SystemData>> &future) {
+            auto &data = *future.get();
+            predictor_.invalidate();
+            if (data.systemDict) {
+                ime_->dict()->setTrie(libime::PinyinDictionary::SystemDict,
+                                      std::move(*data.systemDict));
+            }
+            if (data.userDict) {
+                ime_->dict()->setTrie(libime::PinyinDictionary::UserDict,
+                                      std::move(*data.userDict));
+            }
+            bool userDataLoaded = !data.userDataFailed;
+            // History is parsed here since the model is used by existing
+            // input context, it is usually much smaller than dictionary.
+            if (!data.history.empty()) {
+                try {
+                    std::istringstream in(std::move(data.history));
+                    ime_->model()->load(in);
+                } catch (const std::exception &e) {
+                    PINYIN_ERROR()
+                        << "Failed to load pinyin history: " << e.what();
+                    userDataLoaded = false;
+                }
+            }
+            // Learning since last full save.
+            journal_.replay([this](const LearningJournal::Operation &op) {
+                applyJournal(op);
+            });
+            // Saving now would replace what can't be read.
+            userDataLoaded_ = userDataLoaded;
+            if (!userDataLoaded_) {
+                PINYIN_ERROR() << "Pinyin user data is not loaded, it won't "
+                                  "be saved in this session.";
+            }
+            PINYIN_DEBUG() << "Load pinyin system dict finished.";
+            setReady();
+        }));
+}
+
+void PinyinEngine::setReady() {
+    ready_ = true;
+    // Refresh whatever is typed before dictionaries are ready.
+    instance_->inputContextManager().foreach([this](InputContext *ic) {
+        const auto *entry = instance_->inputMethodEntry(ic);
+        if (!entry || entry->addon() != "pinyin") {
+            return true;
+        }
+        auto *state = ic->propertyFor(&factory_);
+        if (state->mode_ != PinyinMode::Normal ||
+            state->context_.userInput().empty()) {
+            return true;
+        }
+        auto userInput = state->context_.userInput();
+        auto cursor = state->context_.cursor();
+        state->context_.clear();
+        state->context_.type(userInput);
+        state->context_.setCursor(cursor);
+        updateUI(ic);
+        return true;
+    });
+    for (const auto &callback : readyCallbacks_.view()) {
+        callback();
+    }
+}
+
 void PinyinEngine::loadBuiltInDict() {
     const auto &standardPath = StandardPaths::global();
     {
@@ -925,6 +1177,7 @@ void PinyinEngine::loadExtraDict() {
                  libime::TrieDictionary::UserDict + NumBuiltInDict + 1)
         << "Dict size: " << ime_->dict()->dictSize();
     tasks_.clear();
+    predictor_.invalidate();
     ime_->dict()->removeFrom(libime::TrieDictionary::UserDict + NumBuiltInDict +
                              1);
     for (auto &file : files) {
@@ -1095,19 +1348,11 @@ void PinyinEngine::populateConfig() {
             ime_->correctionProfile().get()));
     }
 
-    quickphraseTriggerRegex_.clear();
-    for (const std::string &regStr : *config_.quickphraseTriggerRegex) {
-        try {
-            std::regex reg{regStr};
-            quickphraseTriggerRegex_.push_back(std::move(reg));
-        } catch (const std::exception &e) {
-            PINYIN_DEBUG() << "Invalid regular expression: \"" << regStr
-                           << "\", " << e.what();
-        }
-    }
+    quickphraseTrigger_.compile(*config_.quickphraseTriggerRegex);
     PINYIN_DEBUG() << "Quick Phrase Trigger Regex size: "
-                   << quickphraseTriggerRegex_.size();
+                   << quickphraseTrigger_.size();
 
+    predictor_.invalidate();
     ime_->dict()->setFlags(libime::TrieDictionary::UserDict + 1,
                            *config_.chaiziEnabled
                                ? libime::PinyinDictFlag::FullMatch
@@ -1124,6 +1369,9 @@ void PinyinEngine::reloadConfig() {
     PINYIN_DEBUG() << "Reload pinyin config.";
     readAsIni(config_, "conf/pinyin.conf");
     populateConfig();
+#ifdef FCITX_HAS_LUA
+    luaBatchTrigger_ = true;
+#endif
 }
 void PinyinEngine::activate(const fcitx::InputMethodEntry &entry,
                             fcitx::InputContextEvent &event) {
@@ -1438,6 +1686,34 @@ bool PinyinEngine::handleNextPage(KeyEvent &event) const {
     return false;
 }
 
+void PinyinEngine::cacheStrokeCandidates(InputContext *inputContext) {
+    auto *state = inputContext->propertyFor(&factory_);
+    auto &chars = state->strokeChars_;
+    chars.clear();
+    state->strokeOffsets_.clear();
+    state->strokeOffsets_.push_back(0);
+    state->strokeMatched_.clear();
+    auto *origCandidateList = state->strokeCandidateList_->toBulk();
+    for (int i = 0; i < origCandidateList->totalSize(); i++) {
+        const auto &candidate = origCandidateList->candidateFromAll(i);
+        auto str = candidate.text().toStringForCommit();
+        // Candidate with invalid text never matches.
+        if (auto length = utf8::lengthValidated(str);
+            length != utf8::INVALID_LENGTH && length >= 1) {
+            for (auto chr : utf8::MakeUTF8CharRange(str)) {
+                chars.push_back(chr);
+            }
+        }
+        if (chars.size() > state->strokeOffsets_.back()) {
+            state->strokeMatched_.push_back(i);
+        }
+        state->strokeOffsets_.push_back(chars.size());
+    }
+    state->candidateStrokes_ =
+        pinyinhelper()->call<IPinyinHelper::lookupPackedStrokes>(chars);
+    state->strokeMatchedLength_ = 0;
+}
+
 void PinyinEngine::updateStroke(InputContext *inputContext) {
     auto *state = inputContext->propertyFor(&factory_);
     auto &inputPanel = inputContext->inputPanel();
@@ -1455,40 +1731,60 @@ void PinyinEngine::updateStroke(InputContext *inputContext) {
     candidateList->setCursorPositionAfterPaging(
         CursorPositionAfterPaging::ResetToFirst);
 
+    // Strokes are only typed or removed at the end, so typing more can only
+    // narrow down the previous result.
+    const auto length = state->strokeBuffer_.size();
+    if (length < state->strokeMatchedLength_) {
+        state->strokeMatched_.clear();
+        for (size_t i = 0; i + 1 < state->strokeOffsets_.size(); i++) {
+            state->strokeMatched_.push_back(i);
+        }
+    }
+    const auto &input = state->strokeBuffer_.userInput();
+    const auto prefix = packStrokes(input);
+    // Packed strokes only keep the first PackedStrokeMaxLength strokes, longer
+    // input is checked again against the full stroke string.
+    auto matches = [this, state, &input, prefix](size_t j) {
+        if (!packedStrokesStartsWith(state->candidateStrokes_[j], prefix)) {
+            return false;
+        }
+        if (input.size() <= PackedStrokeMaxLength) {
+            return true;
+        }
+        return stringutils::startsWith(
+            pinyinhelper()->call<IPinyinHelper::reverseLookupStroke>(
+                utf8::UCS4ToUTF8(state->strokeChars_[j])),
+            input);
+    };
+    if (!input.empty() && !prefix) {
+        // Too long to be packed, nothing can match.
+        state->strokeMatched_.clear();
+    }
+    std::erase_if(state->strokeMatched_, [state, &matches](int i) {
+        for (auto j = state->strokeOffsets_[i];
+             j < state->strokeOffsets_[i + 1]; j++) {
+            if (matches(j)) {
+                return false;
+            }
+        }
+        return true;
+    });
+    state->strokeMatchedLength_ = length;
+
     auto *origCandidateList = state->strokeCandidateList_->toBulk();
-    for (int i = 0; i < origCandidateList->totalSize(); i++) {
+    for (int i : state->strokeMatched_) {
         const auto &candidate = origCandidateList->candidateFromAll(i);
-        auto str = candidate.text().toStringForCommit();
-        if (auto length = utf8::lengthValidated(str);
-            length != utf8::INVALID_LENGTH && length >= 1) {
-            auto charRange = utf8::MakeUTF8CharRange(str);
-            bool strokeMatched = false;
-            for (auto iter = std::begin(charRange), end = std::end(charRange);
-                 iter != end; ++iter) {
-                std::string chr(iter.charRange().first,
-                                iter.charRange().second);
-                auto stroke =
-                    pinyinhelper()->call<IPinyinHelper::reverseLookupStroke>(
-                        chr);
-                if (stroke.starts_with(state->strokeBuffer_.userInput())) {
-                    strokeMatched = true;
-                    break;
-                }
-            }
-            if (strokeMatched) {
-                // PinyinCandidateWord is the only forgettable.
-                if (dynamic_cast<const PinyinCandidateWord *>(&candidate)) {
-                    candidateList->append<StrokeFilterCandidateWord<
-                        FilteredForgettableCandidate,
-                        FilteredInsertableAsCustomPhrase>>(this, inputContext,
-                                                           candidate.text(), i);
-                } else if (dynamic_cast<const InsertableAsCustomPhraseInterface
-                                            *>(&candidate)) {
-                    candidateList->append<StrokeFilterCandidateWord<
-                        FilteredInsertableAsCustomPhrase>>(this, inputContext,
-                                                           candidate.text(), i);
-                }
-            }
+        // PinyinCandidateWord is the only forgettable.
+        if (dynamic_cast<const PinyinCandidateWord *>(&candidate)) {
+            candidateList->append<StrokeFilterCandidateWord<
+                FilteredForgettableCandidate,
+                FilteredInsertableAsCustomPhrase>>(this, inputContext,
+                                                   candidate.text(), i);
+        } else if (dynamic_cast<const InsertableAsCustomPhraseInterface *>(
+                       &candidate)) {
+            candidateList->append<
+                StrokeFilterCandidateWord<FilteredInsertableAsCustomPhrase>>(
+                this, inputContext, candidate.text(), i);
         }
     }
     candidateList->setSelectionKey(selectionKeys_);
@@ -1547,6 +1843,10 @@ void PinyinEngine::resetStroke(InputContext *inputContext) const {
     auto *state = inputContext->propertyFor(&factory_);
     state->strokeCandidateList_.reset();
     state->strokeBuffer_.clear();
+    state->candidateStrokes_.clear();
+    state->strokeOffsets_.clear();
+    state->strokeMatched_.clear();
+    state->strokeMatchedLength_ = 0;
     if (state->mode_ == PinyinMode::StrokeFilter) {
         state->mode_ = PinyinMode::Normal;
     }
@@ -1566,15 +1866,19 @@ void PinyinEngine::forgetCandidate(InputContext *inputContext, size_t index) {
     const std::string currentInput = state->context_.userInput();
 
     if (index < state->context_.candidatesToCursor().size()) {
+        // Forgotten words should not show up in prediction anymore.
+        predictor_.invalidate();
         const auto &sentence = state->context_.candidatesToCursor()[index];
         // If this is a word, remove it from user dict.
         if (sentence.size() == 1) {
             auto py = state->context_.candidateFullPinyin(index);
             state->context_.ime()->dict()->removeWord(
                 libime::PinyinDictionary::UserDict, py, sentence.toString());
+            appendJournal({"remove", py, sentence.toString()});
         }
         for (const auto &word : sentence.sentence()) {
             state->context_.ime()->model()->history().forget(word->word());
+            appendJournal({"forget", word->word()});
         }
     }
     resetForgetCandidate(inputContext);
@@ -1649,6 +1953,7 @@ bool PinyinEngine::handleStrokeFilter(
             resetStroke(inputContext);
             state->strokeCandidateList_ = std::move(candidateList);
             state->mode_ = PinyinMode::StrokeFilter;
+            cacheStrokeCandidates(inputContext);
             updateStroke(inputContext);
             handleNextPage(event);
 
@@ -1715,8 +2020,11 @@ bool PinyinEngine::handleStrokeFilter(
             {FcitxKey_p, '3'},
             {FcitxKey_n, '4'},
             {FcitxKey_z, '5'}};
+        // No char has that many strokes, don't let the input grow beyond what
+        // can be packed.
         if (auto iter = strokeMap.find(event.key().sym());
-            iter != strokeMap.end()) {
+            iter != strokeMap.end() &&
+            state->strokeBuffer_.size() < PackedStrokeMaxInputLength) {
             state->strokeBuffer_.type(iter->second);
             updateStroke(inputContext);
         }
@@ -1904,6 +2212,7 @@ bool PinyinEngine::handleCompose(KeyEvent &event) {
 
 void PinyinEngine::resetPredict(InputContext *inputContext) {
     auto *state = inputContext->propertyFor(&factory_);
+    state->predictTask_.reset();
     if (!state->predictWords_) {
         return;
     }
@@ -1919,6 +2228,10 @@ void PinyinEngine::keyEvent(const InputMethodEntry &entry, KeyEvent &event) {
                    << event.isRelease();
     auto *inputContext = event.inputContext();
     auto *state = inputContext->propertyFor(&factory_);
+    // A late prediction must not replace what this key shows.
+    if (!event.isRelease()) {
+        state->predictTask_.reset();
+    }
 
     std::shared_future<uint32_t> keyChr =
         std::async(std::launch::deferred, [sym = event.key().sym()] {
@@ -2009,32 +2322,32 @@ void PinyinEngine::keyEvent(const InputMethodEntry &entry, KeyEvent &event) {
     };
 
     if (!event.key().hasModifier() && quickphrase() &&
-        !quickphraseTriggerRegex_.empty() && !keyStr.get().empty() &&
+        !quickphraseTrigger_.empty() && !keyStr.get().empty() &&
         state->context_.selectedLength() == 0 &&
         state->context_.cursor() == state->context_.size()) {
         std::string text =
             stringutils::concat(state->context_.userInput(), keyStr.get());
-        for (const auto &reg : quickphraseTriggerRegex_) {
-            if (std::regex_search(text, reg,
-                                  std::regex_constants::match_default)) {
-                // Keep the current state before reset.
-                const std::string origin = state->context_.userInput();
-                doReset(inputContext);
-                quickphrase()->call<IQuickPhrase::trigger>(inputContext, "", "",
-                                                           "", "", Key());
-                quickphrase()->call<IQuickPhrase::setBufferWithRestoreCallback>(
-                    inputContext, text, origin,
-                    [this](InputContext *ic, const std::string &origin) {
-                        if (this->instance()->inputMethodEngine(ic) == this) {
-                            auto *state = ic->propertyFor(&factory_);
-                            doReset(ic);
-                            state->context_.type(origin);
-                            updateUI(ic);
-                        }
-                    });
-                event.filterAndAccept();
-                return;
-            }
+        // Input usually only grows by the key, which is all the cursor needs
+        // to match.
+        if (quickphraseTrigger_.match(state->quickphraseTriggerCursor_,
+                                      text)) {
+            // Keep the current state before reset.
+            const std::string origin = state->context_.userInput();
+            doReset(inputContext);
+            quickphrase()->call<IQuickPhrase::trigger>(inputContext, "", "",
+                                                       "", "", Key());
+            quickphrase()->call<IQuickPhrase::setBufferWithRestoreCallback>(
+                inputContext, text, origin,
+                [this](InputContext *ic, const std::string &origin) {
+                    if (this->instance()->inputMethodEngine(ic) == this) {
+                        auto *state = ic->propertyFor(&factory_);
+                        doReset(ic);
+                        state->context_.type(origin);
+                        updateUI(ic);
+                    }
+                });
+            event.filterAndAccept();
+            return;
         }
     }
 
@@ -2218,10 +2531,14 @@ void PinyinEngine::setSubConfig(const std::string &path,
     if (path == "dictmanager") {
         loadExtraDict();
     } else if (path == "clearuserdict") {
+        predictor_.invalidate();
         ime_->dict()->clear(libime::PinyinDictionary::UserDict);
+        appendJournal({"clearuserdict"});
     } else if (path == "clearalldict") {
+        predictor_.invalidate();
         ime_->dict()->clear(libime::PinyinDictionary::UserDict);
         ime_->model()->history().clear();
+        appendJournal({"clearalldict"});
     } else if (path == "customphrase") {
         loadCustomPhrase();
     }
@@ -2241,6 +2558,11 @@ void PinyinEngine::doReset(InputContext *inputContext) const {
     state->context_.clear();
     state->context_.clearContextWords();
     state->predictWords_.reset();
+    state->predictTask_.reset();
+#ifdef FCITX_HAS_LUA
+    state->luaTriggerCache_.clear();
+    state->luaTriggerInput_.clear();
+#endif
     inputContext->inputPanel().reset();
     inputContext->updatePreedit();
     inputContext->updateUserInterface(UserInterfaceComponent::InputPanel);
@@ -2253,32 +2575,108 @@ void PinyinEngine::doReset(InputContext *inputContext) const {
 
 void PinyinEngine::save() {
     safeSaveAsIni(config_, "conf/pinyin.conf");
-    const auto &standardPath = StandardPaths::global();
-    standardPath.safeSave(
-        StandardPathsType::PkgData, "pinyin/user.dict", [this](int fd) {
-            OFDStreamBuf buffer(fd);
-            std::ostream out(&buffer);
-            try {
-                ime_->dict()->save(libime::PinyinDictionary::UserDict, out,
-                                   libime::PinyinDictFormat::Binary);
-                return static_cast<bool>(out);
-            } catch (const std::exception &e) {
-                PINYIN_ERROR() << "Failed to save pinyin dict: " << e.what();
-                return false;
-            }
-        });
-    standardPath.safeSave(
-        StandardPathsType::PkgData, "pinyin/user.history", [this](int fd) {
-            OFDStreamBuf buffer(fd);
-            std::ostream out(&buffer);
-            try {
-                ime_->model()->save(out);
-                return true;
-            } catch (const std::exception &e) {
-                PINYIN_ERROR() << "Failed to save pinyin history: " << e.what();
-                return false;
-            }
-        });
+    compactJournal();
+}
+
+void PinyinEngine::appendJournal(LearningJournal::Operation op) {
+    journal_.append(op);
+    saver_.markDirty();
+}
+
+void PinyinEngine::applyJournal(const LearningJournal::Operation &op) {
+    const auto &name = op[0];
+    auto *dict = ime_->dict();
+    auto &history = ime_->model()->history();
+    if (name == "learn" && op.size() % 2 == 1) {
+        // Same as what PinyinContext::learn does.
+        std::vector<std::string> words;
+        std::vector<std::string> pinyins;
+        for (size_t i = 1; i < op.size(); i += 2) {
+            words.push_back(op[i]);
+            pinyins.push_back(op[i + 1]);
+        }
+        if (words.size() > 1 &&
+            std::ranges::none_of(
+                pinyins, [](const std::string &py) { return py.empty(); })) {
+            auto sentence = stringutils::join(words, "");
+            dict->addWord(libime::PinyinDictionary::UserDict,
+                          stringutils::join(pinyins, "'"), sentence);
+            history.add(std::vector<std::string>{std::move(sentence)});
+        } else {
+            history.add(words);
+        }
+    } else if (name == "history") {
+        history.add(std::vector<std::string>(std::next(op.begin()), op.end()));
+    } else if (name == "forget" && op.size() == 2) {
+        history.forget(op[1]);
+    } else if (name == "add" && op.size() == 3) {
+        dict->addWord(libime::PinyinDictionary::UserDict, op[1], op[2]);
+    } else if (name == "remove" && op.size() == 3) {
+        dict->removeWord(libime::PinyinDictionary::UserDict, op[1], op[2]);
+    } else if (name == "clearuserdict") {
+        dict->clear(libime::PinyinDictionary::UserDict);
+    } else if (name == "clearalldict") {
+        dict->clear(libime::PinyinDictionary::UserDict);
+        history.clear();
+    } else {
+        PINYIN_ERROR() << "Unknown learning journal entry: " << op;
+    }
+}
+
+void PinyinEngine::autoSave() {
+    if (journal_.size() >= JournalCompactThreshold) {
+        compactJournal();
+    } else {
+        saver_.run(journal_.syncTask());
+    }
+}
+
+void PinyinEngine::compactJournal() {
+    if (!userDataLoaded_ || !journal_.rotate()) {
+        return;
+    }
+    if (!saveUserData()) {
+        // Keep the rotated operations, history is not saved.
+        journal_.finishRotate(false);
+        return;
+    }
+    saver_.afterSaved(journal_.removeRotatedTask(),
+                      [this](bool success) { journal_.finishRotate(success); });
+}
+
+bool PinyinEngine::saveUserData() {
+    if (!userDataLoaded_) {
+        return false;
+    }
+    // Only take a snapshot here, writing to disk is done by the worker.
+    // Copying the trie is much cheaper than serializing it.
+    auto userDict = std::make_shared<libime::PinyinDictionary>();
+    userDict->setTrie(libime::PinyinDictionary::UserDict,
+                      *ime_->dict()->trie(libime::PinyinDictionary::UserDict));
+    saver_.save("pinyin/user.dict", [userDict](std::ostream &out) {
+        try {
+            userDict->save(libime::PinyinDictionary::UserDict, out,
+                           libime::PinyinDictFormat::Binary);
+            return true;
+        } catch (const std::exception &e) {
+            PINYIN_ERROR() << "Failed to save pinyin dict: " << e.what();
+            return false;
+        }
+    });
+
+    std::ostringstream history;
+    try {
+        ime_->model()->save(history);
+    } catch (const std::exception &e) {
+        PINYIN_ERROR() << "Failed to save pinyin history: " << e.what();
+        return false;
+    }
+    saver_.save("pinyin/user.history",
+                [history = std::move(history).str()](std::ostream &out) {
+                    out << history;
+                    return true;
+                });
+    return true;
 }
 
 std::string PinyinEngine::subMode(const InputMethodEntry &entry,
@@ -2431,6 +2829,7 @@ void PinyinEngine::cloudPinyinSelected(InputContext *inputContext,
         }
         // if pinyin is not valid, it may throw
         try {
+            auto lock = predictor_.lock();
             if (utf8::length(wordView) == 1 &&
                 std::all_of(words.begin(), words.end(),
                             [](const std::string &w) {
@@ -2442,6 +2841,7 @@ void PinyinEngine::cloudPinyinSelected(InputContext *inputContext,
                 words.push_back(word);
                 ime_->dict()->addWord(libime::PinyinDictionary::UserDict,
                                       joined, word);
+                appendJournal({"add", joined, word});
             } else {
                 if (state->context_.useShuangpin()) {
                     bool end = false;
@@ -2468,9 +2868,13 @@ void PinyinEngine::cloudPinyinSelected(InputContext *inputContext,
                     << "Cloud pinyin saves word: " << wordView << " " << joined;
                 ime_->dict()->addWord(libime::PinyinDictionary::UserDict,
                                       joined, wordView);
+                appendJournal({"add", joined, std::string{wordView}});
                 words.push_back(std::string{wordView});
             }
             ime_->model()->history().add(words);
+            LearningJournal::Operation op{"history"};
+            op.insert(op.end(), words.begin(), words.end());
+            appendJournal(std::move(op));
         } catch (const std::exception &e) {
             PINYIN_DEBUG() << "Failed to save cloudpinyin: " << e.what();
         }
@@ -7,9 +7,15 @@
 #ifndef _PINYIN_PINYIN_H_
 #define _PINYIN_PINYIN_H_
 
+#include "../../common/asyncprediction.h"
+#include "../../common/backgroundsaver.h"
+#include "../../common/learningjournal.h"
+#include "../../common/lrucache.h"
+#include "../../common/workerthread.h"
 #include "customphrase.h"
+#include "pinyin_public.h"
+#include "quickphrasetrigger.h"
 #include "symboldictionary.h"
-#include "workerthread.h"
 #include <cstddef>
 #include <cstdint>
 #include <fcitx-config/configuration.h>
@@ -45,9 +51,9 @@
 #include <list>
 #include <memory>
 #include <optional>
-#include <regex>
 #include <string>
 #include <string_view>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -182,6 +188,10 @@ FCITX_CONFIGURATION(
         cloudPinyinIndex{this, "CloudPinyinIndex",
                          _("Cloud Pinyin Candidate Order"), 2,
                          IntConstrain(1, 10)};
+    Option<int, IntConstrain, DefaultMarshaller<int>, OptionalHideInDescription>
+        cloudPinyinCandidates{this, "CloudPinyinCandidates",
+                              _("Number of Cloud Pinyin Candidates"), 1,
+                              IntConstrain(1, 5)};
     OptionWithAnnotation<bool, OptionalHideInDescription> cloudPinyinAnimation{
         this, "CloudPinyinAnimation",
         _("Show animation when Cloud Pinyin is loading"), true};
@@ -355,6 +365,9 @@ class PinyinEngine;
 
 enum class PinyinMode { Normal, StrokeFilter, ForgetCandidate, Punctuation };
 
+using PinyinPredictionResult =
+    std::vector<std::pair<std::string, libime::PinyinPredictionSource>>;
+
 class PinyinState : public InputContextProperty {
 public:
     PinyinState(PinyinEngine *engine);
@@ -367,6 +380,14 @@ public:
     // Stroke filter
     std::shared_ptr<CandidateList> strokeCandidateList_;
     InputBuffer strokeBuffer_;
+    // Chars of each candidate in strokeCandidateList_ and their packed
+    // strokes, candidate i owns [strokeOffsets_[i], strokeOffsets_[i + 1]).
+    std::vector<uint32_t> strokeChars_;
+    std::vector<uint64_t> candidateStrokes_;
+    std::vector<size_t> strokeOffsets_;
+    // Candidates matching the first strokeMatchedLength_ strokes.
+    std::vector<int> strokeMatched_;
+    size_t strokeMatchedLength_ = 0;
 
     // Forget candidate
     std::shared_ptr<CandidateList> forgetCandidateList_;
@@ -374,6 +395,17 @@ public:
     std::unique_ptr<EventSourceTime> cancelLastEvent_;
 
     std::optional<std::vector<std::string>> predictWords_;
+    // Pending prediction, dropped once anything else updates the panel.
+    std::unique_ptr<TaskToken> predictTask_;
+
+    QuickPhraseTrigger::Cursor quickphraseTriggerCursor_;
+
+#ifdef FCITX_HAS_LUA
+    // Candidates of luaTriggerInput_ without any lua trigger result, which
+    // are still valid while the user keeps typing or deleting at the end.
+    std::unordered_set<std::string> luaTriggerCache_;
+    std::string luaTriggerInput_;
+#endif
 
     int keyReleased_ = -1;
     int keyReleasedIndex_ = -2;
@@ -435,6 +467,15 @@ public:
 
     const auto &selectionKeys() const { return selectionKeys_; }
 
+    bool ready() const { return ready_; }
+    std::unique_ptr<HandlerTableEntry<PinyinReadyCallback>>
+    watchReady(PinyinReadyCallback callback) {
+        return readyCallbacks_.add(std::move(callback));
+    }
+
+    FCITX_ADDON_EXPORT_FUNCTION(PinyinEngine, ready);
+    FCITX_ADDON_EXPORT_FUNCTION(PinyinEngine, watchReady);
+
 private:
     void cloudPinyinSelected(InputContext *inputContext,
                              const std::string &selected,
@@ -456,9 +497,11 @@ private:
 
     std::string evaluateCustomPhrase(InputContext *inputContext,
                                      std::string_view key);
+    std::vector<std::string> spellHint(const std::string &word, int limit);
 
     void populateConfig();
 
+    void cacheStrokeCandidates(InputContext *inputContext);
     void updateStroke(InputContext *inputContext);
     void updateForgetCandidate(InputContext *inputContext);
 
@@ -472,9 +515,14 @@ private:
     std::string preeditCommitString(InputContext *inputContext) const;
 
 #ifdef FCITX_HAS_LUA
+    std::vector<std::vector<std::string>>
+    luaCandidateTrigger(InputContext *ic,
+                        const std::vector<std::string> &candidates);
     std::vector<std::string>
     luaCandidateTrigger(InputContext *ic, const std::string &candidateString);
 #endif
+    void loadSystemDict();
+    void setReady();
     void loadBuiltInDict();
     void loadExtraDict();
     void loadCustomPhrase();
@@ -482,12 +530,18 @@ private:
     void loadDict(const std::string &fullPath,
                   std::list<std::unique_ptr<TaskToken>> &taskTokens);
     void saveCustomPhrase();
+    // Return false if the data is not loaded or can't be serialized.
+    bool saveUserData();
+    void appendJournal(LearningJournal::Operation op);
+    void applyJournal(const LearningJournal::Operation &op);
+    void autoSave();
+    void compactJournal();
 
     Instance *instance_;
     PinyinEngineConfig config_;
     PinyinEngineConfig pyConfig_;
     std::unique_ptr<libime::PinyinIME> ime_;
-    std::vector<std::regex> quickphraseTriggerRegex_;
+    QuickPhraseTrigger quickphraseTrigger_;
     KeyList selectionKeys_;
     KeyList numpadSelectionKeys_;
     FactoryFor<PinyinState> factory_;
@@ -499,8 +553,27 @@ private:
     CustomPhraseDict customPhrase_;
     SymbolDict symbols_;
     WorkerThread worker_;
+    AsyncPrediction<PinyinPredictionResult> predictor_;
     std::list<std::unique_ptr<TaskToken>> persistentTask_;
     std::list<std::unique_ptr<TaskToken>> tasks_;
+    // Whether loading system dict, user dict and history is done. Before that,
+    // the engine only offers raw input and does not learn anything.
+    bool ready_ = false;
+    // Whether user dict and history are loaded and the journal is replayed,
+    // nothing is written to them before that.
+    bool userDataLoaded_ = false;
+#ifdef FCITX_HAS_LUA
+    // Cleared until the next reload if pinyin.lua is not there to handle the
+    // batched call.
+    bool luaBatchTrigger_ = true;
+#endif
+    HandlerTable<PinyinReadyCallback> readyCallbacks_;
+    LRUCache<std::string, std::vector<std::string>> spellHintCache_{
+        SpellHintCacheSize};
+    // Learning is appended here, and only compacted into user.dict and
+    // user.history once it grows large enough, or on save.
+    LearningJournal journal_;
+    BackgroundSaver saver_;
 
     FCITX_ADDON_DEPENDENCY_LOADER(quickphrase, instance_->addonManager());
     FCITX_ADDON_DEPENDENCY_LOADER(fullwidth, instance_->addonManager());
@@ -512,6 +585,9 @@ private:
     FCITX_ADDON_DEPENDENCY_LOADER(imeapi, instance_->addonManager());
 
     static constexpr size_t NumBuiltInDict = 2;
+    static constexpr size_t JournalCompactThreshold = 1000;
+    static constexpr size_t LuaTriggerCacheSize = 256;
+    static constexpr size_t SpellHintCacheSize = 32;
 };
 
 } // namespace fcitx
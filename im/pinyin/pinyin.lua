@@ -491,3 +491,17 @@ ime.register_command("sj", "pinyin_get_time", "输入时间", "alpha", "输入
 ime.register_command("rq", "pinyin_get_date", "输入日期", "alpha", "输入可选日期，例如2013-01-01")
 ime.register_trigger("pinyin_get_current_time", "显示时间", {}, {'时间'})
 ime.register_trigger("pinyin_get_today", "显示日期", {}, {'日期'})
+
+-- Run candidateTrigger for a list of candidates, so the engine doesn't need
+-- to call into lua once per candidate. An error of one trigger only empties
+-- its own result, the engine takes a failed batch as a missing function.
+function pinyin_candidate_trigger_batch(candidates)
+    local result = {}
+    local n = tonumber(candidates.Length) or #candidates
+    for i = 1, n do
+        local candidate = candidates[i] or candidates[tostring(i - 1)]
+        local ok, ret = pcall(candidateTrigger, candidate)
+        result[i] = ok and ret or {}
+    end
+    return result
+end
@@ -0,0 +1,25 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _PINYIN_PINYIN_PUBLIC_H_
+#define _PINYIN_PINYIN_PUBLIC_H_
+
+#include <fcitx-utils/handlertable.h>
+#include <fcitx/addoninstance.h>
+#include <functional>
+#include <memory>
+
+using PinyinReadyCallback = std::function<void()>;
+
+/* Whether system dictionary, user dictionary and history are loaded */
+FCITX_ADDON_DECLARE_FUNCTION(PinyinEngine, ready, bool());
+/* Callback is invoked on the main thread once the engine becomes ready */
+FCITX_ADDON_DECLARE_FUNCTION(
+    PinyinEngine, watchReady,
+    std::unique_ptr<fcitx::HandlerTableEntry<PinyinReadyCallback>>(
+        PinyinReadyCallback));
+
+#endif // _PINYIN_PINYIN_PUBLIC_H_
@@ -313,7 +313,8 @@ CustomCloudPinyinCandidateWord::CustomCloudPinyinCandidateWord(
     CloudPinyinSelectedCallback callback, int order)
     : CloudPinyinCandidateWord(engine->cloudpinyin(), pinyin, selectedSentence,
                                *engine->config().keepCloudPinyinPlaceHolder,
-                               inputContext, std::move(callback)),
+                               inputContext, std::move(callback),
+                               *engine->config().cloudPinyinCandidates),
       PinyinAbstractCandidateWord(pinyin.size(), order) {
     if (filled() || !*engine->config().cloudPinyinAnimation) {
         return;
@@ -340,6 +341,19 @@ CustomCloudPinyinCandidateWord::CustomCloudPinyinCandidateWord(
         });
 }
 
+CloudPinyinExtraWord::CloudPinyinExtraWord(
+    const CloudPinyinCandidateWord *cloud, const std::string &word,
+    size_t selectLength, int order)
+    : CloudPinyinExtraCandidateWord(word, cloud->selectedSentence(),
+                                    cloud->callback()),
+      PinyinAbstractCandidateWord(selectLength, order) {}
+
+std::unique_ptr<CloudPinyinExtraWord>
+CustomCloudPinyinCandidateWord::extraWord(const std::string &word) const {
+    return std::make_unique<CloudPinyinExtraWord>(this, word, selectLength(),
+                                                  order());
+}
+
 void CustomCloudPinyinCandidateWord::select(InputContext *inputContext) const {
     if ((!filled() || word().empty()) && order() == 0) {
         auto candidateList = inputContext->inputPanel().candidateList();
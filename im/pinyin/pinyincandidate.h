@@ -230,6 +230,17 @@ public:
     size_t idx_;
 };
 
+class CloudPinyinExtraWord : public CloudPinyinExtraCandidateWord,
+                            public PinyinAbstractCandidateWord,
+                            public InsertableAsCustomPhraseInterface {
+public:
+    CloudPinyinExtraWord(const CloudPinyinCandidateWord *cloud,
+                         const std::string &word, size_t selectLength,
+                         int order);
+
+    std::string customPhraseString() const override { return word(); }
+};
+
 class CustomCloudPinyinCandidateWord
     : public CloudPinyinCandidateWord,
       public PinyinAbstractCandidateWord,
@@ -248,6 +259,13 @@ public:
         return filled() ? word() : "";
     }
 
+    std::unique_ptr<CloudPinyinExtraWord>
+    extraWord(const std::string &word) const;
+    std::unique_ptr<CandidateWord>
+    makeExtraCandidate(const std::string &word) const override {
+        return extraWord(word);
+    }
+
 private:
     static constexpr std::array<std::string_view, 4> ProgerssString = {
         "◐",
@@ -0,0 +1,573 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "quickphrasetrigger.h"
+#include <algorithm>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fcitx-utils/log.h>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace fcitx {
+
+namespace {
+
+// Thrown when a pattern uses something the compiler doesn't handle.
+struct Unsupported {};
+
+// Repeat with a larger count is left to std::regex.
+constexpr int MaxRepeat = 64;
+
+struct Node {
+    enum class Type { Bytes, Concat, Alternate, Repeat };
+
+    Type type = Type::Concat;
+    std::bitset<256> bytes;
+    std::vector<Node> children;
+    int min = 0;
+    // -1 means no limit.
+    int max = -1;
+};
+
+std::bitset<256> byteSet(unsigned char c) {
+    std::bitset<256> result;
+    result.set(c);
+    return result;
+}
+
+std::bitset<256> rangeSet(unsigned char from, unsigned char to) {
+    std::bitset<256> result;
+    for (int c = from; c <= to; c++) {
+        result.set(c);
+    }
+    return result;
+}
+
+struct Branch {
+    Node node;
+    bool anchoredStart = false;
+    bool anchoredEnd = false;
+};
+
+// Recursive descent parser for the ECMAScript syntax used by std::regex.
+class Parser {
+public:
+    explicit Parser(std::string_view pattern) : pattern_(pattern) {}
+
+    std::vector<Branch> parse() {
+        std::vector<Branch> branches;
+        while (true) {
+            Branch branch;
+            branch.anchoredStart = consume('^');
+            branch.node = parseConcat();
+            branch.anchoredEnd = consume('$');
+            branches.push_back(std::move(branch));
+            if (atEnd()) {
+                break;
+            }
+            if (!consume('|')) {
+                throw Unsupported();
+            }
+        }
+        return branches;
+    }
+
+private:
+    bool atEnd() const { return pos_ >= pattern_.size(); }
+    char peek() const { return pattern_[pos_]; }
+    bool consume(char c) {
+        if (!atEnd() && peek() == c) {
+            pos_++;
+            return true;
+        }
+        return false;
+    }
+    char next() {
+        if (atEnd()) {
+            throw Unsupported();
+        }
+        return pattern_[pos_++];
+    }
+
+    Node parseAlternate() {
+        Node node;
+        node.type = Node::Type::Alternate;
+        do {
+            node.children.push_back(parseConcat());
+        } while (consume('|'));
+        return node;
+    }
+
+    Node parseConcat() {
+        Node node;
+        node.type = Node::Type::Concat;
+        while (!atEnd() && peek() != '|' && peek() != ')' && peek() != '$') {
+            node.children.push_back(parseRepeat());
+        }
+        return node;
+    }
+
+    Node parseRepeat() {
+        Node atom = parseAtom();
+        int min;
+        int max;
+        if (consume('*')) {
+            min = 0;
+            max = -1;
+        } else if (consume('+')) {
+            min = 1;
+            max = -1;
+        } else if (consume('?')) {
+            min = 0;
+            max = 1;
+        } else if (consume('{')) {
+            min = parseNumber();
+            max = min;
+            if (consume(',')) {
+                max = (!atEnd() && peek() == '}') ? -1 : parseNumber();
+            }
+            if (!consume('}') || (max != -1 && max < min)) {
+                throw Unsupported();
+            }
+        } else {
+            return atom;
+        }
+        // Lazy or greedy doesn't change whether there is a match.
+        consume('?');
+        Node node;
+        node.type = Node::Type::Repeat;
+        node.min = min;
+        node.max = max;
+        node.children.push_back(std::move(atom));
+        return node;
+    }
+
+    int parseNumber() {
+        int value = 0;
+        size_t digits = 0;
+        while (!atEnd() && peek() >= '0' && peek() <= '9') {
+            value = value * 10 + (next() - '0');
+            if (value > MaxRepeat) {
+                throw Unsupported();
+            }
+            digits++;
+        }
+        if (!digits) {
+            throw Unsupported();
+        }
+        return value;
+    }
+
+    Node parseAtom() {
+        Node node;
+        node.type = Node::Type::Bytes;
+        const char c = next();
+        switch (c) {
+        case '(':
+            if (consume('?')) {
+                // Only non-capturing group, no lookahead.
+                if (!consume(':')) {
+                    throw Unsupported();
+                }
+            }
+            node = parseAlternate();
+            if (!consume(')')) {
+                throw Unsupported();
+            }
+            return node;
+        case '[':
+            node.bytes = parseClass();
+            return node;
+        case '.':
+            node.bytes.set();
+            node.bytes.reset('\n');
+            node.bytes.reset('\r');
+            return node;
+        case '\\':
+            if (auto set = parseEscape(false); set.any()) {
+                node.bytes = set;
+                return node;
+            }
+            throw Unsupported();
+        case '^':
+        case '$':
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+        case ')':
+        case '|':
+            throw Unsupported();
+        default:
+            node.bytes = byteSet(c);
+            return node;
+        }
+    }
+
+    // The escaped char is already consumed. Return an empty set if it is
+    // not a char or a class.
+    std::bitset<256> parseEscape(bool inClass) {
+        const char c = next();
+        switch (c) {
+        case 'd':
+            return rangeSet('0', '9');
+        case 'D':
+            return ~rangeSet('0', '9');
+        case 'w':
+            return wordSet();
+        case 'W':
+            return ~wordSet();
+        case 's':
+            return spaceSet();
+        case 'S':
+            return ~spaceSet();
+        case 't':
+            return byteSet('\t');
+        case 'n':
+            return byteSet('\n');
+        case 'r':
+            return byteSet('\r');
+        case 'f':
+            return byteSet('\f');
+        case 'v':
+            return byteSet('\v');
+        case 'b':
+            // Word boundary outside of class.
+            return inClass ? byteSet('\b') : std::bitset<256>();
+        case '0':
+            if (!atEnd() && peek() >= '0' && peek() <= '9') {
+                return {};
+            }
+            return byteSet('\0');
+        case 'x': {
+            int value = 0;
+            for (int i = 0; i < 2; i++) {
+                const char h = next();
+                if (h >= '0' && h <= '9') {
+                    value = value * 16 + (h - '0');
+                } else if (h >= 'a' && h <= 'f') {
+                    value = value * 16 + (h - 'a' + 10);
+                } else if (h >= 'A' && h <= 'F') {
+                    value = value * 16 + (h - 'A' + 10);
+                } else {
+                    return {};
+                }
+            }
+            return byteSet(value);
+        }
+        default:
+            // Back reference, \B, \c, \u and so on.
+            if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+                (c >= 'A' && c <= 'Z')) {
+                return {};
+            }
+            return byteSet(c);
+        }
+    }
+
+    static std::bitset<256> wordSet() {
+        return rangeSet('a', 'z') | rangeSet('A', 'Z') | rangeSet('0', '9') |
+               byteSet('_');
+    }
+
+    static std::bitset<256> spaceSet() {
+        return byteSet(' ') | rangeSet('\t', '\r');
+    }
+
+    std::bitset<256> parseClass() {
+        std::bitset<256> result;
+        const bool negate = consume('^');
+        while (!consume(']')) {
+            auto [item, single] = parseClassItem();
+            if (single >= 0 && !atEnd() && peek() == '-' &&
+                pos_ + 1 < pattern_.size() && pattern_[pos_ + 1] != ']') {
+                pos_++;
+                auto [_, to] = parseClassItem();
+                if (to < single) {
+                    throw Unsupported();
+                }
+                item = rangeSet(single, to);
+            }
+            result |= item;
+        }
+        return negate ? ~result : result;
+    }
+
+    // Return the set, and the byte if it is a single byte.
+    std::pair<std::bitset<256>, int> parseClassItem() {
+        const char c = next();
+        if (c == '[' && !atEnd() &&
+            (peek() == ':' || peek() == '.' || peek() == '=')) {
+            // POSIX class.
+            throw Unsupported();
+        }
+        if (c != '\\') {
+            return {byteSet(c), static_cast<unsigned char>(c)};
+        }
+        auto set = parseEscape(true);
+        if (set.none()) {
+            throw Unsupported();
+        }
+        return {set, set.count() == 1 ? firstByte(set) : -1};
+    }
+
+    static int firstByte(const std::bitset<256> &set) {
+        for (int i = 0; i < 256; i++) {
+            if (set.test(i)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    std::string_view pattern_;
+    size_t pos_ = 0;
+};
+
+} // namespace
+
+// Thompson construction, every fragment has a single end state that only has
+// epsilon transitions.
+class QuickPhraseTriggerCompiler {
+public:
+    explicit QuickPhraseTriggerCompiler(QuickPhraseTrigger &trigger)
+        : nfa_(trigger.nfa_) {}
+
+    void addBranch(const Branch &branch, std::vector<int> &anchored,
+                   std::vector<int> &unanchored) {
+        auto [start, end] = compile(branch.node);
+        const int match = newState();
+        nfa_[match].match = !branch.anchoredEnd;
+        nfa_[match].matchAtEnd = branch.anchoredEnd;
+        nfa_[end].epsilon.push_back(match);
+        (branch.anchoredStart ? anchored : unanchored).push_back(start);
+    }
+
+private:
+    int newState() {
+        nfa_.emplace_back();
+        return nfa_.size() - 1;
+    }
+
+    std::pair<int, int> compile(const Node &node) {
+        switch (node.type) {
+        case Node::Type::Bytes: {
+            const int start = newState();
+            const int end = newState();
+            nfa_[start].consume = true;
+            nfa_[start].bytes = node.bytes;
+            nfa_[start].next = end;
+            return {start, end};
+        }
+        case Node::Type::Concat: {
+            const int start = newState();
+            int end = start;
+            for (const auto &child : node.children) {
+                auto [childStart, childEnd] = compile(child);
+                nfa_[end].epsilon.push_back(childStart);
+                end = childEnd;
+            }
+            return {start, end};
+        }
+        case Node::Type::Alternate: {
+            const int start = newState();
+            const int end = newState();
+            for (const auto &child : node.children) {
+                auto [childStart, childEnd] = compile(child);
+                nfa_[start].epsilon.push_back(childStart);
+                nfa_[childEnd].epsilon.push_back(end);
+            }
+            return {start, end};
+        }
+        case Node::Type::Repeat:
+            break;
+        }
+
+        const auto &child = node.children[0];
+        const int start = newState();
+        int end = start;
+        for (int i = 0; i < node.min; i++) {
+            auto [childStart, childEnd] = compile(child);
+            nfa_[end].epsilon.push_back(childStart);
+            end = childEnd;
+        }
+        if (node.max < 0) {
+            // Loop back to the state before the child.
+            const int loop = newState();
+            const int loopEnd = newState();
+            auto [childStart, childEnd] = compile(child);
+            nfa_[end].epsilon.push_back(loop);
+            nfa_[loop].epsilon.push_back(childStart);
+            nfa_[loop].epsilon.push_back(loopEnd);
+            nfa_[childEnd].epsilon.push_back(loop);
+            return {start, loopEnd};
+        }
+        for (int i = node.min; i < node.max; i++) {
+            const int optionalEnd = newState();
+            auto [childStart, childEnd] = compile(child);
+            nfa_[end].epsilon.push_back(childStart);
+            nfa_[end].epsilon.push_back(optionalEnd);
+            nfa_[childEnd].epsilon.push_back(optionalEnd);
+            end = optionalEnd;
+        }
+        return {start, end};
+    }
+
+    std::vector<QuickPhraseTrigger::NfaState> &nfa_;
+};
+
+void QuickPhraseTrigger::compile(const std::vector<std::string> &patterns) {
+    nfa_.clear();
+    anchoredStarts_.clear();
+    unanchoredStarts_.clear();
+    fallback_.clear();
+    size_ = 0;
+
+    QuickPhraseTriggerCompiler compiler(*this);
+    for (const auto &pattern : patterns) {
+        // Let std::regex decide what is valid, so the result is the same.
+        std::regex reg;
+        try {
+            reg = std::regex(pattern);
+        } catch (const std::exception &e) {
+            FCITX_DEBUG() << "Invalid regular expression: \"" << pattern
+                          << "\", " << e.what();
+            continue;
+        }
+        size_++;
+        std::vector<Branch> branches;
+        try {
+            branches = Parser(pattern).parse();
+        } catch (const Unsupported &) {
+            fallback_.push_back(std::move(reg));
+            continue;
+        }
+        for (const auto &branch : branches) {
+            compiler.addBranch(branch, anchoredStarts_, unanchoredStarts_);
+        }
+    }
+    resetDfa();
+}
+
+void QuickPhraseTrigger::resetDfa() {
+    dfa_.clear();
+    dfaIndex_.clear();
+    generation_++;
+    visited_.assign(nfa_.size(), 0);
+    visitMark_ = 0;
+    std::vector<int> seeds = anchoredStarts_;
+    seeds.insert(seeds.end(), unanchoredStarts_.begin(),
+                 unanchoredStarts_.end());
+    addDfaState(std::move(seeds));
+}
+
+int QuickPhraseTrigger::addDfaState(std::vector<int> seeds) {
+    DfaState state;
+    // Epsilon closure, only consuming states are kept.
+    visitMark_++;
+    stack_ = std::move(seeds);
+    while (!stack_.empty()) {
+        const int current = stack_.back();
+        stack_.pop_back();
+        if (visited_[current] == visitMark_) {
+            continue;
+        }
+        visited_[current] = visitMark_;
+        const auto &nfaState = nfa_[current];
+        if (nfaState.consume) {
+            state.states.push_back(current);
+        }
+        state.matched = state.matched || nfaState.match;
+        state.matchedAtEnd = state.matchedAtEnd || nfaState.matchAtEnd;
+        stack_.insert(stack_.end(), nfaState.epsilon.begin(),
+                      nfaState.epsilon.end());
+    }
+    if (state.matched) {
+        // Once matched, the rest of the text doesn't matter.
+        state.states.clear();
+        state.matchedAtEnd = false;
+    } else {
+        std::sort(state.states.begin(), state.states.end());
+    }
+
+    auto key =
+        std::make_tuple(state.states, state.matched, state.matchedAtEnd);
+    if (auto iter = dfaIndex_.find(key); iter != dfaIndex_.end()) {
+        return iter->second;
+    }
+    const int index = dfa_.size();
+    state.next.fill(state.matched ? index : -1);
+    dfa_.push_back(std::move(state));
+    dfaIndex_.emplace(std::move(key), index);
+    return index;
+}
+
+int QuickPhraseTrigger::advance(int state, std::string_view text) {
+    for (const char c : text) {
+        const auto byte = static_cast<unsigned char>(c);
+        int next = dfa_[state].next[byte];
+        if (next < 0) {
+            std::vector<int> seeds = unanchoredStarts_;
+            for (const int nfaState : dfa_[state].states) {
+                if (nfa_[nfaState].bytes.test(byte)) {
+                    seeds.push_back(nfa_[nfaState].next);
+                }
+            }
+            next = addDfaState(std::move(seeds));
+            dfa_[state].next[byte] = next;
+        }
+        state = next;
+    }
+    return state;
+}
+
+bool QuickPhraseTrigger::accepted(int state) const {
+    return dfa_[state].matched || dfa_[state].matchedAtEnd;
+}
+
+bool QuickPhraseTrigger::match(std::string_view text) {
+    Cursor cursor;
+    return match(cursor, text);
+}
+
+bool QuickPhraseTrigger::match(Cursor &cursor, std::string_view text) {
+    if (empty()) {
+        return false;
+    }
+    if (dfa_.size() > MaxDfaStates) {
+        resetDfa();
+    }
+    int state;
+    if (cursor.generation == generation_ && cursor.state >= 0 &&
+        text.starts_with(cursor.text)) {
+        state = advance(cursor.state, text.substr(cursor.text.size()));
+    } else {
+        state = advance(0, text);
+    }
+    cursor.text = text;
+    cursor.state = state;
+    cursor.generation = generation_;
+    if (accepted(state)) {
+        return true;
+    }
+
+    const std::string textString(text);
+    return std::any_of(fallback_.begin(), fallback_.end(),
+                       [&textString](const std::regex &reg) {
+                           return std::regex_search(
+                               textString, reg,
+                               std::regex_constants::match_default);
+                       });
+}
+
+} // namespace fcitx
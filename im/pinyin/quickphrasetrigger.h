@@ -0,0 +1,99 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _PINYIN_QUICKPHRASETRIGGER_H_
+#define _PINYIN_QUICKPHRASETRIGGER_H_
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace fcitx {
+
+/**
+ * Match text against a list of regular expressions, like std::regex_search
+ * with any of them.
+ *
+ * Common patterns (literals, classes, groups, alternation, quantifiers, and
+ * ^/$ around a whole branch) are compiled into a single NFA, which is turned
+ * into a DFA lazily while matching. Anything else, e.g. back references or
+ * lookahead, is still matched with std::regex.
+ */
+class QuickPhraseTrigger {
+public:
+    // Remember the DFA state of the text, so text that grows at the end only
+    // needs to feed the new bytes.
+    struct Cursor {
+        std::string text;
+        int state = -1;
+        uint64_t generation = 0;
+    };
+
+    // Invalid patterns are skipped.
+    void compile(const std::vector<std::string> &patterns);
+
+    bool empty() const { return !size_; }
+    // Number of valid patterns.
+    size_t size() const { return size_; }
+    // Number of patterns that need std::regex.
+    size_t fallbackSize() const { return fallback_.size(); }
+
+    bool match(std::string_view text);
+    bool match(Cursor &cursor, std::string_view text);
+
+private:
+    static constexpr size_t MaxDfaStates = 1024;
+
+    struct NfaState {
+        std::bitset<256> bytes;
+        bool consume = false;
+        int next = -1;
+        std::vector<int> epsilon;
+        // Reaching this state means a match, or a match only at the end.
+        bool match = false;
+        bool matchAtEnd = false;
+    };
+
+    struct DfaState {
+        std::vector<int> states;
+        bool matched = false;
+        bool matchedAtEnd = false;
+        std::array<int, 256> next;
+    };
+
+    friend class QuickPhraseTriggerCompiler;
+
+    void resetDfa();
+    int addDfaState(std::vector<int> seeds);
+    int advance(int state, std::string_view text);
+    bool accepted(int state) const;
+
+    std::vector<NfaState> nfa_;
+    std::vector<int> anchoredStarts_;
+    std::vector<int> unanchoredStarts_;
+    std::vector<DfaState> dfa_;
+    std::map<std::tuple<std::vector<int>, bool, bool>, int> dfaIndex_;
+    uint64_t generation_ = 0;
+    // Buffers reused by addDfaState.
+    std::vector<int> stack_;
+    std::vector<uint64_t> visited_;
+    uint64_t visitMark_ = 0;
+
+    std::vector<std::regex> fallback_;
+    size_t size_ = 0;
+};
+
+} // namespace fcitx
+
+#endif // _PINYIN_QUICKPHRASETRIGGER_H_
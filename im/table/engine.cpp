@@ -59,7 +59,8 @@ TableEngine::TableEngine(Instance *instance)
     : instance_(instance),
       factory_([this](InputContext &ic) { return new TableState(&ic, this); }) {
     ime_ = std::make_unique<TableIME>(
-        &libime::DefaultLanguageModelResolver::instance());
+        &libime::DefaultLanguageModelResolver::instance(),
+        instance_->eventLoop(), instance_->eventDispatcher());
 
     reloadConfig();
     instance_->inputContextManager().registerProperty("tableState", &factory_);
@@ -20,20 +20,24 @@
 #include <fstream>
 #include <ios>
 #include <istream>
+#include <iterator>
 #include <libime/core/languagemodel.h>
 #include <libime/core/userlanguagemodel.h>
 #include <libime/core/utils.h>
 #include <libime/table/tablebaseddictionary.h>
+#include <libime/table/tablecontext.h>
 #include <libime/table/tableoptions.h>
 #include <memory>
 #include <ostream>
 #include <ranges>
 #include <set>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <tuple>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 namespace fcitx {
 
@@ -94,7 +98,10 @@ void populateOptions(libime::TableBasedDictionary *dict,
 }
 } // namespace
 
-TableIME::TableIME(libime::LanguageModelResolver *lm) : lm_(lm) {}
+TableIME::TableIME(libime::LanguageModelResolver *lm, EventLoop &loop,
+                   EventDispatcher &dispatcher)
+    : lm_(lm), saver_(loop, dispatcher, [this]() { autoSave(); }),
+      prediction_(dispatcher) {}
 
 std::tuple<libime::TableBasedDictionary *, libime::UserLanguageModel *,
            const TableConfig *>
@@ -212,6 +219,14 @@ TableIME::requestDict(const std::string &name) {
             } catch (const std::exception &e) {
                 TABLE_DEBUG() << e.what();
             }
+
+            // Learning since last full save.
+            iter->second.journal = std::make_unique<LearningJournal>(
+                stringutils::concat("table/", name, ".journal"));
+            iter->second.journal->replay(
+                [&data = iter->second](const LearningJournal::Operation &op) {
+                    applyJournal(data, op);
+                });
         }
     }
 
@@ -221,10 +236,78 @@ TableIME::requestDict(const std::string &name) {
 
 void TableIME::saveAll() {
     for (const auto &p : tables_) {
-        saveDict(p.first);
+        compactJournal(p.first);
     }
 }
 
+void TableIME::appendJournal(const std::string &name,
+                             LearningJournal::Operation op) {
+    auto iter = tables_.find(name);
+    if (iter == tables_.end() || !iter->second.journal ||
+        !*iter->second.root.config->learning) {
+        return;
+    }
+    iter->second.journal->append(op);
+    saver_.markDirty();
+}
+
+void TableIME::applyJournal(TableData &data,
+                            const LearningJournal::Operation &op) {
+    const auto &name = op[0];
+    auto &history = data.model->history();
+    if (name == "learn") {
+        // History part of TableContext::learn, words it adds to the
+        // dictionary are journaled as "insert".
+        history.add(std::vector<std::string>(std::next(op.begin()), op.end()));
+    } else if (name == "autophrase" && op.size() >= 2) {
+        libime::TableContext context(*data.dict, *data.model);
+        const std::vector<std::string> hints(std::next(op.begin(), 2),
+                                             op.end());
+        context.learnAutoPhrase(op[1], hints);
+    } else if (name == "insert" && op.size() == 3) {
+        data.dict->insert(op[1], op[2], libime::PhraseFlag::User);
+    } else if (name == "remove" && op.size() == 3) {
+        data.dict->removeWord(op[1], op[2]);
+    } else if (name == "forget" && op.size() == 2) {
+        history.forget(op[1]);
+    } else {
+        TABLE_ERROR() << "Unknown learning journal entry: " << op;
+    }
+}
+
+void TableIME::autoSave() {
+    for (const auto &[name, data] : tables_) {
+        if (!data.journal) {
+            continue;
+        }
+        if (data.journal->size() >= JournalCompactThreshold) {
+            compactJournal(name);
+        } else {
+            saver_.run(data.journal->syncTask());
+        }
+    }
+}
+
+void TableIME::compactJournal(const std::string &name) {
+    auto iter = tables_.find(name);
+    if (iter == tables_.end() || !iter->second.journal ||
+        !iter->second.journal->rotate()) {
+        return;
+    }
+    if (!saveDict(name)) {
+        // Keep the rotated operations, user data is not saved.
+        iter->second.journal->finishRotate(false);
+        return;
+    }
+    saver_.afterSaved(iter->second.journal->removeRotatedTask(),
+                      [this, name](bool success) {
+                          auto iter = tables_.find(name);
+                          if (iter != tables_.end() && iter->second.journal) {
+                              iter->second.journal->finishRotate(success);
+                          }
+                      });
+}
+
 void TableIME::updateConfig(const std::string &name, const RawConfig &config) {
     auto iter = tables_.find(name);
     if (iter == tables_.end()) {
@@ -244,7 +327,8 @@ void TableIME::releaseUnusedDict(const std::unordered_set<std::string> &names) {
     for (auto iter = tables_.begin(); iter != tables_.end();) {
         if (!names.contains(iter->first)) {
             TABLE_DEBUG() << "Release unused table: " << iter->first;
-            saveDict(iter->first);
+            compactJournal(iter->first);
+            prediction_.invalidate();
             iter = tables_.erase(iter);
         } else {
             ++iter;
@@ -252,41 +336,40 @@ void TableIME::releaseUnusedDict(const std::unordered_set<std::string> &names) {
     }
 }
 
-void TableIME::saveDict(const std::string &name) {
+bool TableIME::saveDict(const std::string &name) {
     auto iter = tables_.find(name);
     if (iter == tables_.end()) {
-        return;
+        return false;
     }
     libime::TableBasedDictionary *dict = iter->second.dict.get();
     libime::UserLanguageModel *lm = iter->second.model.get();
     if (!dict || !lm || !*iter->second.root.config->learning) {
-        return;
+        // Nothing is learned.
+        return true;
     }
     auto fileName = stringutils::joinPath("table", name);
 
-    StandardPaths::global().safeSave(StandardPathsType::PkgData,
-                                     fileName + ".user.dict", [dict](int fd) {
-                                         OFDStreamBuf buffer(fd);
-                                         std::ostream out(&buffer);
-                                         try {
-                                             dict->saveUser(out);
-                                             return static_cast<bool>(out);
-                                         } catch (const std::exception &) {
-                                             return false;
-                                         }
-                                     });
-
-    StandardPaths::global().safeSave(StandardPathsType::PkgData,
-                                     fileName + ".history", [lm](int fd) {
-                                         OFDStreamBuf buffer(fd);
-                                         std::ostream out(&buffer);
-                                         try {
-                                             lm->save(out);
-                                             return static_cast<bool>(out);
-                                         } catch (const std::exception &) {
-                                             return false;
-                                         }
-                                     });
+    // Serialize into memory here, and leave the disk IO to the worker.
+    std::ostringstream userDict;
+    std::ostringstream history;
+    try {
+        dict->saveUser(userDict);
+        lm->save(history);
+    } catch (const std::exception &e) {
+        TABLE_ERROR() << "Failed to save table " << name << ": " << e.what();
+        return false;
+    }
+    saver_.save(fileName + ".user.dict",
+                [data = std::move(userDict).str()](std::ostream &out) {
+                    out << data;
+                    return true;
+                });
+    saver_.save(fileName + ".history",
+                [data = std::move(history).str()](std::ostream &out) {
+                    out << data;
+                    return true;
+                });
+    return true;
 }
 
 void TableIME::reloadAllDict() {
@@ -294,6 +377,7 @@ void TableIME::reloadAllDict() {
     for (const auto &pair : tables_) {
         names.insert(pair.first);
     }
+    prediction_.invalidate();
     tables_.clear();
     for (const auto &name : names) {
         requestDict(name);
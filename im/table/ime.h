@@ -7,10 +7,16 @@
 #ifndef _TABLE_TABLEDICTRESOLVER_H_
 #define _TABLE_TABLEDICTRESOLVER_H_
 
+#include "../../common/asyncprediction.h"
+#include "../../common/backgroundsaver.h"
+#include "../../common/learningjournal.h"
+#include <cstddef>
 #include <fcitx-config/configuration.h>
 #include <fcitx-config/enum.h>
 #include <fcitx-config/option.h>
 #include <fcitx-config/rawconfig.h>
+#include <fcitx-utils/eventdispatcher.h>
+#include <fcitx-utils/eventloopinterface.h>
 #include <fcitx-utils/i18n.h>
 #include <fcitx-utils/key.h>
 #include <fcitx-utils/keysym.h>
@@ -318,27 +324,48 @@ struct TableData {
     TableConfigRoot root;
     std::unique_ptr<libime::TableBasedDictionary> dict;
     std::unique_ptr<libime::UserLanguageModel> model;
+    std::unique_ptr<LearningJournal> journal;
 };
 
 class TableIME {
 public:
-    TableIME(libime::LanguageModelResolver *lmResolver);
+    TableIME(libime::LanguageModelResolver *lmResolver, EventLoop &loop,
+             EventDispatcher &dispatcher);
 
     const TableConfig &config(const std::string &name);
 
     std::tuple<libime::TableBasedDictionary *, libime::UserLanguageModel *,
                const TableConfig *>
     requestDict(const std::string &name);
-    void saveDict(const std::string &name);
+    // Return false if the data can't be serialized, nothing is saved then.
+    bool saveDict(const std::string &name);
     void saveAll();
+    // Record learning of the table, so it can be replayed on next start.
+    void appendJournal(const std::string &name, LearningJournal::Operation op);
     void updateConfig(const std::string &name, const RawConfig &config);
 
     void releaseUnusedDict(const std::unordered_set<std::string> &names);
     void reloadAllDict();
 
+    // Next word prediction of all tables, language models need to be changed
+    // with its lock held.
+    AsyncPrediction<std::vector<std::string>> &prediction() {
+        return prediction_;
+    }
+
 private:
+    static void applyJournal(TableData &data,
+                             const LearningJournal::Operation &op);
+    void autoSave();
+    void compactJournal(const std::string &name);
+
+    static constexpr size_t JournalCompactThreshold = 1000;
+
     libime::LanguageModelResolver *lm_;
     std::unordered_map<std::string, TableData> tables_;
+    BackgroundSaver saver_;
+    // Declared after tables_, so the models outlive pending predictions.
+    AsyncPrediction<std::vector<std::string>> prediction_;
 };
 
 FCITX_DECLARE_LOG_CATEGORY(table_logcategory);
@@ -34,6 +34,7 @@
 #include <initializer_list>
 #include <iterator>
 #include <libime/core/historybigram.h>
+#include <libime/core/prediction.h>
 #include <libime/pinyin/pinyinencoder.h>
 #include <libime/pinyin/shuangpinprofile.h>
 #include <libime/table/tablebaseddictionary.h>
@@ -47,6 +48,66 @@
 
 namespace fcitx {
 
+namespace {
+
+// Words that are added to history by learn and learnLast.
+LearningJournal::Operation learnOperation(TableContext *context, size_t from) {
+    LearningJournal::Operation op{"learn"};
+    for (size_t i = from; i < context->selectedSize(); i++) {
+        auto seg = context->selectedSegment(i);
+        if (std::get<bool>(seg)) {
+            op.push_back(std::get<std::string>(seg));
+        }
+    }
+    return op;
+}
+
+// Besides history, learn and learnLast may add the selected words, or the
+// sentence of them, to the dictionary. Check them before and after, so the
+// added ones are journaled as "insert".
+class LearnedWords {
+public:
+    LearnedWords(TableContext *context, size_t from) : dict_(context->dict()) {
+        std::string sentence;
+        for (size_t i = from; i < context->selectedSize(); i++) {
+            auto seg = context->selectedSegment(i);
+            if (!std::get<bool>(seg)) {
+                continue;
+            }
+            const auto &word = std::get<std::string>(seg);
+            add(context->selectedCode(i), word);
+            add("", word);
+            sentence += word;
+        }
+        add("", sentence);
+    }
+
+    void appendJournal(TableIME *ime, const std::string &name) const {
+        for (const auto &[code, word] : words_) {
+            if (dict_.wordExists(code, word) == libime::PhraseFlag::User) {
+                ime->appendJournal(name, {"insert", code, word});
+            }
+        }
+    }
+
+private:
+    void add(std::string code, const std::string &word) {
+        if (word.empty() || (code.empty() && !dict_.generate(word, code)) ||
+            dict_.wordExists(code, word) == libime::PhraseFlag::User) {
+            return;
+        }
+        std::pair<std::string, std::string> item(std::move(code), word);
+        if (std::ranges::find(words_, item) == words_.end()) {
+            words_.push_back(std::move(item));
+        }
+    }
+
+    const libime::TableBasedDictionary &dict_;
+    std::vector<std::pair<std::string, std::string>> words_;
+};
+
+} // namespace
+
 TableContext *TableState::updateContext(const InputMethodEntry *entry) {
     if (!entry || lastContext_ == entry->uniqueName()) {
         return context_.get();
@@ -131,6 +192,9 @@ void TableState::pushLastCommit(const std::string &code,
         TABLE_DEBUG() << "learnAutoPhrase " << autoPhraseBuffer_ << " "
                       << singleCharString << codeHints;
         context_->learnAutoPhrase(singleCharString, codeHints);
+        LearningJournal::Operation op{"autophrase", singleCharString};
+        op.insert(op.end(), codeHints.begin(), codeHints.end());
+        engine_->ime()->appendJournal(lastContext_, std::move(op));
     } else {
         autoPhraseBuffer_.clear();
     }
@@ -153,6 +217,7 @@ void TableState::pushLastCommit(const std::string &code,
 }
 
 void TableState::reset(const InputMethodEntry *entry) {
+    predictTask_.reset();
     auto *context = updateContext(entry);
     if (context) {
         context->clear();
@@ -218,14 +283,30 @@ void TableState::predict() {
     if (predictWord.empty()) {
         return;
     }
-    const std::vector<std::string> predictWords{std::move(predictWord)};
-    auto words = context_->prediction()->predict(
-        predictWords, *engine_->config().predictionSize);
-    if (auto candidateList = predictCandidateList(words)) {
-        auto &inputPanel = ic_->inputPanel();
-        inputPanel.setCandidateList(std::move(candidateList));
-    }
-    ic_->updateUserInterface(UserInterfaceComponent::InputPanel);
+    const int size = *engine_->config().predictionSize;
+    auto key = stringutils::concat(lastContext_, "\n", std::to_string(size),
+                                   "\n", predictWord);
+    // The prediction of context_ may be gone before the worker is done, use
+    // a new one over the same model.
+    predictTask_ = engine_->ime()->prediction().predict(
+        std::move(key),
+        [model = &context_->mutableModel(),
+         predictWords = std::vector<std::string>{std::move(predictWord)},
+         size]() {
+            libime::Prediction prediction;
+            prediction.setUserLanguageModel(model);
+            return prediction.predict(predictWords, size);
+        },
+        [this](const std::vector<std::string> &words) {
+            if (!context_) {
+                return;
+            }
+            if (auto candidateList = predictCandidateList(words)) {
+                auto &inputPanel = ic_->inputPanel();
+                inputPanel.setCandidateList(std::move(candidateList));
+            }
+            ic_->updateUserInterface(UserInterfaceComponent::InputPanel);
+        });
 }
 
 bool TableState::isContextEmpty() const {
@@ -587,6 +668,8 @@ bool TableState::handleLookupPinyinOrModifyDictionaryMode(KeyEvent &event) {
                 if (wordFlag == libime::PhraseFlag::Invalid) {
                     context_->mutableDict().insert(result, subString.first,
                                                    libime::PhraseFlag::User);
+                    engine_->ime()->appendJournal(
+                        lastContext_, {"insert", result, subString.first});
                     reset();
                     return true;
                 }
@@ -594,6 +677,8 @@ bool TableState::handleLookupPinyinOrModifyDictionaryMode(KeyEvent &event) {
                     context_->mutableDict().removeWord(result, subString.first);
                     context_->mutableDict().insert(result, subString.first,
                                                    libime::PhraseFlag::User);
+                    engine_->ime()->appendJournal(
+                        lastContext_, {"insert", result, subString.first});
                     reset();
                 }
             }
@@ -614,8 +699,13 @@ bool TableState::handleLookupPinyinOrModifyDictionaryMode(KeyEvent &event) {
                         event.key().check(FcitxKey_Delete)) {
                         context_->mutableDict().removeWord(result,
                                                            subString.first);
+                        engine_->ime()->appendJournal(
+                            lastContext_, {"remove", result, subString.first});
                     }
+                    engine_->ime()->prediction().invalidate();
                     context_->mutableModel().history().forget(subString.first);
+                    engine_->ime()->appendJournal(lastContext_,
+                                                  {"forget", subString.first});
                     reset();
                     return true;
                 }
@@ -734,8 +824,11 @@ void TableState::forgetCandidateWord(size_t idx) {
     if (!code.empty()) {
         auto word = context_->candidates()[idx].toString();
         commitBuffer(false);
+        engine_->ime()->prediction().invalidate();
         context_->mutableDict().removeWord(code, word);
         context_->mutableModel().history().forget(word);
+        engine_->ime()->appendJournal(lastContext_, {"remove", code, word});
+        engine_->ime()->appendJournal(lastContext_, {"forget", word});
     } else {
         return;
     }
@@ -756,6 +849,10 @@ void TableState::keyEvent(const InputMethodEntry &entry, KeyEvent &event) {
     if (!context) {
         return;
     }
+    // A late prediction must not replace what this key shows.
+    if (!event.isRelease()) {
+        predictTask_.reset();
+    }
 
     const auto &config = context->config();
     // 2nd/3rd selection is allowed to be modifier only, handle them before we
@@ -1262,7 +1359,14 @@ void TableState::commitBuffer(bool commitCode, bool noRealCommit) {
     if (!ic_->capabilityFlags().testAny(CapabilityFlag::PasswordOrSensitive) &&
         (!*context->config().commitAfterSelect ||
          *context->config().useContextBasedOrder)) {
-        context->learn();
+        auto op = learnOperation(context, 0);
+        const LearnedWords words(context, 0);
+        {
+            auto lock = engine_->ime()->prediction().lock();
+            context->learn();
+        }
+        engine_->ime()->appendJournal(lastContext_, std::move(op));
+        words.appendJournal(engine_->ime(), lastContext_);
     }
     context->clear();
 }
@@ -1286,7 +1390,14 @@ void TableState::commitAfterSelect(int commitFrom) {
     if (!*config.useContextBasedOrder) {
         if (!ic_->capabilityFlags().testAny(
                 CapabilityFlag::PasswordOrSensitive)) {
-            context->learnLast();
+            auto op = learnOperation(context, context->selectedSize() - 1);
+            const LearnedWords words(context, context->selectedSize() - 1);
+            {
+                auto lock = engine_->ime()->prediction().lock();
+                context->learnLast();
+            }
+            engine_->ime()->appendJournal(lastContext_, std::move(op));
+            words.appendJournal(engine_->ime(), lastContext_);
         }
     }
 }
@@ -44,6 +44,8 @@ public:
     TableEngine *engine_;
     bool lastIsPunc_ = false;
     std::unique_ptr<EventSourceTime> cancelLastEvent_;
+    // Pending prediction, dropped once anything else updates the panel.
+    std::unique_ptr<TaskToken> predictTask_;
 
     TableContext *updateContext(const InputMethodEntry *entry);
     void release();
@@ -6,19 +6,41 @@
  */
 #include "chttrans-native.h"
 #include "chttrans.h"
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <fcitx-utils/cutf8.h>
 #include <fcitx-utils/fdstreambuf.h>
 #include <fcitx-utils/standardpaths.h>
 #include <fcitx-utils/utf8.h>
 #include <fcntl.h>
 #include <istream>
 #include <string>
-#include <string_view>
 
 #define TABLE_GBKS2T "chttrans/gbks2t.tab"
 
 using namespace fcitx;
 
+NativeBackend::MapType::MapType()
+    : index_((MaxChar >> PageBits) + 1, 0), pages_(1) {
+    pages_[0].fill(0);
+}
+
+void NativeBackend::MapType::insert(uint32_t from, uint32_t to) {
+    if (from > MaxChar) {
+        return;
+    }
+    auto &page = index_[from >> PageBits];
+    if (!page) {
+        page = static_cast<uint16_t>(pages_.size());
+        pages_.emplace_back().fill(0);
+    }
+    auto &value = pages_[page][from & (PageSize - 1)];
+    if (!value) {
+        value = to;
+    }
+}
+
 bool NativeBackend::loadOnce(const ChttransConfig & /*unused*/) {
     auto file =
         StandardPaths::global().open(StandardPathsType::PkgData, TABLE_GBKS2T);
@@ -37,38 +59,69 @@ bool NativeBackend::loadOnce(const ChttransConfig & /*unused*/) {
         uint32_t trad;
 
         auto tradStart = utf8::getNextChar(simpStart, strBuf.end(), &simp);
-        auto end = utf8::getNextChar(tradStart, strBuf.end(), &trad);
+        utf8::getNextChar(tradStart, strBuf.end(), &trad);
         if (!utf8::isValidChar(simp) || !utf8::isValidChar(trad)) {
             continue;
         }
-        std::string_view simpView(simpStart, tradStart);
-        std::string_view tradView(tradStart, end);
-        s2tMap_.try_emplace(std::string(simpView), tradView);
-        t2sMap_.try_emplace(std::string(tradView), simpView);
+        s2tMap_.insert(simp, trad);
+        t2sMap_.insert(trad, simp);
     }
     return true;
 }
 
+namespace {
+
+// Length of the ASCII run at the start of str, 8 bytes at a time.
+size_t asciiPrefixLength(const char *str, size_t length) {
+    constexpr uint64_t highBits = 0x8080808080808080ULL;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, str + i, sizeof(word));
+        if (word & highBits) {
+            break;
+        }
+    }
+    while (i < length && !(static_cast<unsigned char>(str[i]) & 0x80)) {
+        i++;
+    }
+    return i;
+}
+
 std::string convert(const NativeBackend::MapType &transMap,
                     const std::string &strHZ) {
     auto len = utf8::lengthValidated(strHZ);
     if (len == utf8::INVALID_LENGTH) {
         return strHZ;
     }
-    auto range = fcitx::utf8::MakeUTF8StringViewRange(strHZ);
     std::string result;
-    for (const auto &value : range) {
-        auto iter = transMap.find(value);
-        if (iter != transMap.end()) {
-            result.append(iter->second);
+    // Simplified and traditional chars have the same length most of time.
+    result.reserve(strHZ.size());
+    const char *data = strHZ.data();
+    const char *end = data + strHZ.size();
+    while (data < end) {
+        const auto ascii = asciiPrefixLength(data, end - data);
+        result.append(data, ascii);
+        data += ascii;
+        if (data == end) {
+            break;
+        }
+        uint32_t chr;
+        const char *next = fcitx_utf8_get_char(data, &chr);
+        if (auto mapped = transMap.lookup(chr)) {
+            char buf[FCITX_UTF8_MAX_LENGTH];
+            result.append(buf, fcitx_ucs4_to_utf8(mapped, buf));
         } else {
-            result.append(value);
+            result.append(data, next);
         }
+        data = next;
     }
 
     return result;
 }
 
+} // namespace
+
 std::string NativeBackend::convertSimpToTrad(const std::string &strHZ) {
     return convert(s2tMap_, strHZ);
 }
@@ -8,24 +8,39 @@
 #define _CHTTRANS_CHTTRANS_NATIVE_H_
 
 #include "chttrans.h"
-#include <functional>
+#include <array>
+#include <cstdint>
 #include <string>
-#include <string_view>
-#include <unordered_map>
+#include <vector>
 
 class NativeBackend : public ChttransBackend {
-    struct string_hash {
-        using is_transparent = void;
+public:
+    // Code point to code point table, split into pages of 256 code points
+    // so pages without any mapping are shared.
+    class MapType {
+    public:
+        MapType();
 
-        size_t operator()(const std::string_view str) const {
-            constexpr std::hash<std::string_view> hasher{};
-            return hasher(str);
+        // Keep the first mapping if there are more than one.
+        void insert(uint32_t from, uint32_t to);
+        // Returns 0 if there is no mapping.
+        uint32_t lookup(uint32_t chr) const {
+            const auto page = chr >> PageBits;
+            if (page >= index_.size()) {
+                return 0;
+            }
+            return pages_[index_[page]][chr & (PageSize - 1)];
         }
+
+    private:
+        static constexpr uint32_t MaxChar = 0x10FFFF;
+        static constexpr uint32_t PageBits = 8;
+        static constexpr uint32_t PageSize = 1 << PageBits;
+        std::vector<uint16_t> index_;
+        // Page 0 is the empty page.
+        std::vector<std::array<uint32_t, PageSize>> pages_;
     };
 
-public:
-    using MapType = std::unordered_map<std::string, std::string, string_hash,
-                                       std::equal_to<>>;
     std::string convertSimpToTrad(const std::string &) override;
     std::string convertTradToSimp(const std::string &) override;
 
@@ -24,6 +24,7 @@
 #include <fcitx/addonmanager.h>
 #include <fcitx/event.h>
 #include <fcitx/inputcontext.h>
+#include <fcitx/inputcontextmanager.h>
 #include <fcitx/inputmethodentry.h>
 #include <fcitx/instance.h>
 #include <fcitx/text.h>
@@ -84,6 +85,8 @@ static ChttransIMType inputMethodEntryType(const InputMethodEntry &entry) {
 }
 
 Chttrans::Chttrans(fcitx::Instance *instance) : instance_(instance) {
+    instance_->inputContextManager().registerProperty("chttransState",
+                                                      &factory_);
     instance_->userInterfaceManager().registerAction("chttrans",
                                                      &toggleAction_);
 #ifdef ENABLE_OPENCC
@@ -144,20 +147,20 @@ Chttrans::Chttrans(fcitx::Instance *instance) : instance_(instance) {
                 return;
             }
             auto oldString = text.toString();
-            auto oldLength = utf8::lengthValidated(oldString);
-            if (oldLength == utf8::INVALID_LENGTH) {
-                return;
-            }
-            auto newString = convert(type, oldString);
-            auto newLength = utf8::lengthValidated(newString);
-            if (newLength == utf8::INVALID_LENGTH) {
+            // Most of the text is the same as last update, e.g. candidates
+            // when paging, or the preedit when moving cursor.
+            const auto &converted =
+                convertCached(inputContext, type, oldString);
+            if (converted.length == utf8::INVALID_LENGTH) {
                 return;
             }
+            const auto &newString = converted.text;
+            const auto newLength = converted.length;
             Text newText;
             // Short cut for most common case, the text contains only one
             // string.
             if (text.size() == 1) {
-                newText.append(std::move(newString), text.formatAt(0));
+                newText.append(newString, text.formatAt(0));
             } else {
                 size_t off = 0;
                 size_t remainLength = newLength;
@@ -221,6 +224,7 @@ void Chttrans::reloadConfig() {
 }
 
 void Chttrans::populateConfig() {
+    generation_ += 1;
     enabledIM_.clear();
     enabledIM_.insert(config_.enabledIM.value().begin(),
                       config_.enabledIM.value().end());
@@ -310,6 +314,30 @@ std::string Chttrans::convert(ChttransIMType type, const std::string &str) {
     return currentBackend_->convertTradToSimp(str);
 }
 
+const ChttransConverted &Chttrans::convertCached(InputContext *inputContext,
+                                                ChttransIMType type,
+                                                const std::string &str) {
+    auto *state = inputContext->propertyFor(&factory_);
+    if (state->generation_ != generation_) {
+        state->cache_.clear();
+        state->generation_ = generation_;
+    }
+    std::string key;
+    key.reserve(str.size() + 1);
+    key.push_back(type == ChttransIMType::Trad ? 't' : 's');
+    key.append(str);
+    if (const auto *converted = state->cache_.find(key)) {
+        return *converted;
+    }
+
+    ChttransConverted converted{.text = str, .length = utf8::INVALID_LENGTH};
+    if (utf8::lengthValidated(str) != utf8::INVALID_LENGTH) {
+        converted.text = convert(type, str);
+        converted.length = utf8::lengthValidated(converted.text);
+    }
+    return *state->cache_.insert(key, std::move(converted));
+}
+
 ChttransIMType
 Chttrans::inputMethodType(fcitx::InputContext *inputContext) const {
     auto *engine = instance_->inputMethodEngine(inputContext);
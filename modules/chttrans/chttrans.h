@@ -7,8 +7,11 @@
 #ifndef _CHTTRANS_CHTTRANS_H_
 #define _CHTTRANS_CHTTRANS_H_
 
+#include "../../common/lrucache.h"
 #include "config.h"
 #include "notifications_public.h"
+#include <cstddef>
+#include <cstdint>
 #include <fcitx-config/configuration.h>
 #include <fcitx-config/enum.h>
 #include <fcitx-config/iniparser.h>
@@ -17,7 +20,9 @@
 #include <fcitx/action.h>
 #include <fcitx/addoninstance.h>
 #include <fcitx/addonmanager.h>
+#include <fcitx/inputcontextproperty.h>
 #include <fcitx/instance.h>
+#include <string>
 #include <unordered_set>
 
 #ifdef ENABLE_OPENCC
@@ -93,6 +98,23 @@ private:
     bool loadResult_ = false;
 };
 
+struct ChttransConverted {
+    std::string text;
+    // INVALID_LENGTH if the text is not valid UTF-8.
+    size_t length;
+};
+
+class ChttransState : public fcitx::InputContextProperty {
+public:
+    static constexpr size_t CacheSize = 64;
+
+    // Recent output of the input context, e.g. candidates of the pages just
+    // shown, keyed by the conversion type and the original text.
+    LRUCache<std::string, ChttransConverted> cache_{CacheSize};
+    // Matches Chttrans::generation_ if the cache is still valid.
+    uint64_t generation_ = 0;
+};
+
 class Chttrans final : public fcitx::AddonInstance {
     class ToggleAction : public fcitx::Action {
     public:
@@ -139,6 +161,10 @@ public:
     // The actual language consider both input method & conversion.
     ChttransIMType currentType(fcitx::InputContext *inputContext) const;
     std::string convert(ChttransIMType type, const std::string &str);
+    // Like convert, but remember the result in the input context.
+    const ChttransConverted &convertCached(fcitx::InputContext *inputContext,
+                                           ChttransIMType type,
+                                           const std::string &str);
     void toggle(fcitx::InputContext *ic);
 
     FCITX_ADDON_DEPENDENCY_LOADER(notifications, instance_->addonManager());
@@ -148,6 +174,10 @@ private:
 
     fcitx::Instance *instance_;
     ChttransConfig config_;
+    fcitx::FactoryFor<ChttransState> factory_{
+        [](fcitx::InputContext &) { return new ChttransState; }};
+    // Bumped when the conversion may change, to drop cached output.
+    uint64_t generation_ = 1;
     std::unique_ptr<fcitx::HandlerTableEntry<fcitx::EventHandler>>
         eventHandler_;
     std::unordered_map<ChttransEngine, std::unique_ptr<ChttransBackend>,
@@ -0,0 +1,106 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _CLOUDPINYIN_CIRCUITBREAKER_H_
+#define _CLOUDPINYIN_CIRCUITBREAKER_H_
+
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * Stop sending requests to a backend that keeps failing.
+ *
+ * After FailureThreshold failures in a row the breaker opens, and no request
+ * is allowed until the backoff passes. Then a single probe request is let
+ * through (half open): success closes the breaker, failure opens it again
+ * with the backoff doubled, up to MaxBackoff. Time is in microseconds.
+ */
+class CircuitBreaker {
+public:
+    enum class State { Closed, Open, HalfOpen };
+
+    static constexpr int FailureThreshold = 3;
+    static constexpr uint64_t InitialBackoff = 5000000;
+    static constexpr uint64_t MaxBackoff = 300000000;
+    // A probe that never reports back, e.g. cancelled, doesn't block the
+    // next one longer than this. It's longer than the request timeout.
+    static constexpr uint64_t ProbeTimeout = 15000000;
+
+    State state(uint64_t now) const {
+        if (!open_) {
+            return State::Closed;
+        }
+        return now < retryTime_ ? State::Open : State::HalfOpen;
+    }
+
+    // Return false if the request should not be sent. In half open state
+    // only one request is allowed, until it is recorded or times out.
+    bool allowRequest(uint64_t now) {
+        switch (state(now)) {
+        case State::Closed:
+            return true;
+        case State::Open:
+            return false;
+        case State::HalfOpen:
+            if (probing_ && now - probeStart_ < ProbeTimeout) {
+                return false;
+            }
+            probing_ = true;
+            probeStart_ = now;
+            return true;
+        }
+        return false;
+    }
+
+    // Return true if the breaker is closed by this.
+    bool recordSuccess() {
+        const bool wasOpen = open_;
+        reset();
+        return wasOpen;
+    }
+
+    // Return true if the breaker is opened by this.
+    bool recordFailure(uint64_t now) {
+        failures_ += 1;
+        if (open_) {
+            // Results of requests sent before it was opened don't count.
+            if (!probing_) {
+                return false;
+            }
+            backoff_ = std::min(backoff_ * 2, MaxBackoff);
+        } else if (failures_ < FailureThreshold) {
+            return false;
+        } else {
+            backoff_ = InitialBackoff;
+        }
+        open_ = true;
+        probing_ = false;
+        retryTime_ = now + backoff_;
+        return true;
+    }
+
+    void reset() {
+        open_ = false;
+        probing_ = false;
+        failures_ = 0;
+        backoff_ = 0;
+        retryTime_ = 0;
+    }
+
+    // Failures in a row.
+    int failures() const { return failures_; }
+    uint64_t retryTime() const { return retryTime_; }
+
+private:
+    bool open_ = false;
+    bool probing_ = false;
+    int failures_ = 0;
+    uint64_t backoff_ = 0;
+    uint64_t retryTime_ = 0;
+    uint64_t probeStart_ = 0;
+};
+
+#endif // _CLOUDPINYIN_CIRCUITBREAKER_H_
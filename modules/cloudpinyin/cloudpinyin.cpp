@@ -8,10 +8,16 @@
 #include "cloudpinyin.h"
 #include "cloudpinyin_public.h"
 #include "fetch.h"
+#include "jsontokenizer.h"
+#include "persistentcache.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
-#include <cstring>
 #include <curl/curl.h>
+#include <deque>
 #include <fcitx-config/iniparser.h>
+#include <fcitx-utils/charutils.h>
 #include <fcitx-utils/eventloopinterface.h>
 #include <fcitx-utils/fs.h>
 #include <fcitx-utils/log.h>
@@ -22,12 +28,18 @@
 #include <fcitx-utils/utf8.h>
 #include <fcitx/addoninstance.h>
 #include <fcitx/addonmanager.h>
+#include <fcitx/inputcontext.h>
+#include <fcitx/instance.h>
 #include <fcntl.h>
+#include <filesystem>
+#include <format>
+#include <iterator>
 #include <memory>
 #include <string>
 #include <string_view>
 #include <unistd.h>
 #include <utility>
+#include <vector>
 
 using namespace fcitx;
 
@@ -38,7 +50,7 @@ FCITX_DEFINE_LOG_CATEGORY(cloudpinyin, "cloudpinyin");
 
 class GoogleBackend : public Backend {
 public:
-    GoogleBackend(std::string url) : url_(std::move(url)) {}
+    GoogleBackend(std::string server) : defaultServer_(std::move(server)) {}
 
     bool prepareRequest(CurlQueue *queue, const std::string &pinyin) override {
         const UniqueCPtr<char, curl_free> escaped(
@@ -46,29 +58,26 @@ public:
         if (!escaped) {
             return false;
         }
-        const std::string url = stringutils::concat(url_, escaped.get());
+        const std::string url =
+            std::format("{}/inputtools/request?ime=pinyin&num={}&text={}",
+                        server(defaultServer_), CurlQueue::MaxCandidates,
+                        escaped.get());
         CLOUDPINYIN_DEBUG() << "Request URL: " << url;
+        queue->setCandidateFilter(&GoogleBackend::isCandidate);
         return (curl_easy_setopt(queue->curl(), CURLOPT_URL, url.c_str()) ==
                 CURLE_OK);
     }
-    std::string parseResult(CurlQueue *queue) override {
-        const std::string_view result(queue->result().data(),
-                                      queue->result().size());
-        CLOUDPINYIN_DEBUG() << "Request result: " << result;
-        auto start = result.find("\",[\"");
-        std::string hanzi;
-        if (start != std::string_view::npos) {
-            start += strlen("\",[\"");
-            auto end = result.find('\"', start);
-            if (end != std::string_view::npos && end > start) {
-                hanzi = result.substr(start, end - start);
-            }
-        }
-        return hanzi;
+
+    // ["SUCCESS",[["nihao",["你好","拟好",...],...]]]
+    static bool isCandidate(const JsonPath &path) {
+        return path.size() == 4 &&
+               std::ranges::none_of(
+                   path, [](const auto &level) { return level.object; }) &&
+               path[0].index == 1 && path[1].index == 0 && path[2].index == 1;
     }
 
 private:
-    const std::string url_;
+    const std::string defaultServer_;
 };
 
 class BaiduBackend : public Backend {
@@ -80,142 +89,623 @@ public:
             return false;
         }
         const std::string url =
-            std::format("https://olimenew.baidu.com/"
-                        "py?input={}&inputtype=py&resultcoding=utf-8",
-                        escaped.get());
+            std::format("{}/py?input={}&inputtype=py&resultcoding=utf-8",
+                        server(defaultServer_), escaped.get());
         CLOUDPINYIN_DEBUG() << "Request URL: " << url;
+        queue->setCandidateFilter(&BaiduBackend::isCandidate);
         return (curl_easy_setopt(queue->curl(), CURLOPT_URL, url.c_str()) ==
                 CURLE_OK);
     }
 
-    std::string parseResult(CurlQueue *queue) override {
-        const std::string_view result(queue->result().data(),
-                                      queue->result().size());
-        CLOUDPINYIN_DEBUG() << "Request result: " << result;
-        auto start = result.find("[[\"");
-        std::string hanzi;
-        if (start != std::string::npos) {
-            start += strlen("[[\"");
-            auto end = result.find("\",", start);
-            if (end != std::string::npos && end > start) {
-                hanzi = result.substr(start, end - start);
-            }
-        }
-        return hanzi;
+    // {"0":[[["你好",5,{...}],["拟好",5,{...}],...]],...}
+    static bool isCandidate(const JsonPath &path) {
+        return path.size() == 4 && path[0].object && !path[1].object &&
+               !path[2].object && !path[3].object && path[1].index == 0 &&
+               path[3].index == 0;
     }
+
+private:
+    const std::string defaultServer_ = "https://olimenew.baidu.com";
 };
 
-constexpr int MAX_ERROR = 10;
-constexpr uint64_t minInUs = 60000000;
+// Write new results to disk at most this long after they arrive.
+constexpr uint64_t PersistentFlushDelay = 30 * 1000000ULL;
+constexpr int64_t SecondsPerDay = 24 * 60 * 60;
+// Relative to the user PkgData directory.
+constexpr std::string_view PersistentCacheDirectory = "cloudpinyin";
+// Prefetch once user stops typing for this long.
+constexpr uint64_t PrefetchDelay = 150000;
+// At most PrefetchBudget prefetch requests in PrefetchBudgetPeriod.
+constexpr size_t PrefetchBudget = 4;
+constexpr uint64_t PrefetchBudgetPeriod = 1000000;
+// Hedge delay if it's not configured, limited by the range below.
+constexpr uint64_t DefaultHedgeDelay = 500000;
+constexpr uint64_t MinHedgeDelay = 100000;
+constexpr uint64_t MaxHedgeDelay = 5000000;
+// Latency of a backend that is never used.
+constexpr uint64_t UnknownLatency = 1000000;
+// Latency recorded for a failed request, same as the timeout.
+constexpr uint64_t FailureLatency = 10000000;
+
+const char *backendName(CloudPinyinBackend backend) {
+    switch (backend) {
+    case CloudPinyinBackend::Google:
+        return "Google";
+    case CloudPinyinBackend::GoogleCN:
+        return "GoogleCN";
+    case CloudPinyinBackend::Baidu:
+        return "Baidu";
+    }
+    return "";
+}
+
+// Results of different servers are kept in different files, the server is
+// part of the name with the characters that are not safe in a file name
+// replaced.
+std::filesystem::path persistentCachePath(CloudPinyinBackend backend,
+                                          const std::string &server) {
+    std::string name;
+    switch (backend) {
+    case CloudPinyinBackend::Google:
+        name = "google";
+        break;
+    case CloudPinyinBackend::GoogleCN:
+        name = "googlecn";
+        break;
+    case CloudPinyinBackend::Baidu:
+        name = "baidu";
+        break;
+    }
+    if (!server.empty()) {
+        name.push_back('-');
+        for (const char c : server) {
+            const bool safe = charutils::isupper(c) || charutils::islower(c) ||
+                              charutils::isdigit(c) || c == '.' || c == '-';
+            name.push_back(safe ? c : '_');
+        }
+    }
+    return std::filesystem::path(PersistentCacheDirectory) /
+           stringutils::concat(name, ".cache");
+}
+
+int64_t currentTime() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
 
 } // namespace
 
 CloudPinyin::CloudPinyin(fcitx::AddonManager *manager)
-    : eventLoop_(manager->eventLoop()),
+    : instance_(manager->instance()), eventLoop_(manager->eventLoop()),
       dispatcher_(manager->instance()->eventDispatcher()) {
     curl_global_init(CURL_GLOBAL_ALL);
 
     backends_.emplace(
         CloudPinyinBackend::Google,
-        std::make_unique<GoogleBackend>(
-            "https://www.google.com/inputtools/request?ime=pinyin&text="));
+        std::make_unique<GoogleBackend>("https://www.google.com"));
     backends_.emplace(
         CloudPinyinBackend::GoogleCN,
-        std::make_unique<GoogleBackend>(
-            "https://www.google.cn/inputtools/request?ime=pinyin&text="));
+        std::make_unique<GoogleBackend>("https://www.google.cn"));
     backends_.emplace(CloudPinyinBackend::Baidu,
                       std::make_unique<BaiduBackend>());
 
-    resetError_ =
-        eventLoop_->addTimeEvent(CLOCK_MONOTONIC, now(CLOCK_MONOTONIC), minInUs,
-                                 [this](EventSourceTime *, uint64_t) {
-                                     resetError();
-                                     return true;
-                                 });
-    if (resetError_) {
-        resetError_->setEnabled(false);
-    }
+    flushPersistent_ = eventLoop_->addTimeEvent(
+        CLOCK_MONOTONIC, now(CLOCK_MONOTONIC), 0,
+        [this](EventSourceTime *, uint64_t) {
+            flushPersistent();
+            return true;
+        });
+    flushPersistent_->setEnabled(false);
+    prefetchTimer_ = eventLoop_->addTimeEvent(
+        CLOCK_MONOTONIC, now(CLOCK_MONOTONIC), 0,
+        [this](EventSourceTime *, uint64_t) {
+            startPrefetch();
+            return true;
+        });
+    prefetchTimer_->setEnabled(false);
     thread_ = std::make_unique<FetchThread>(this);
 
     reloadConfig();
 }
 
-CloudPinyin::~CloudPinyin() {}
+CloudPinyin::~CloudPinyin() {
+    // Pending writes are finished before the fetch thread exits.
+    flushPersistent();
+    thread_.reset();
+}
 
 void CloudPinyin::reloadConfig() {
     readAsIni(config_, "conf/cloudpinyin.conf");
+    populateConfig();
 }
 
-void CloudPinyin::request(const std::string &pinyin,
-                          CloudPinyinCallback callback) {
-    if (static_cast<int>(pinyin.size()) < config_.minimumLength.value()) {
-        callback(pinyin, "");
+void CloudPinyin::populateConfig() {
+    auto server = *config_.server;
+    while (stringutils::endsWith(server, "/")) {
+        server.pop_back();
+    }
+    if (server != server_) {
+        // Results of the old server.
+        cache_.clear();
+        server_ = server;
+        for (const auto &[_, backend] : backends_) {
+            backend->setServer(server);
+        }
+    }
+    // Loaded again with the new limits.
+    flushPersistent();
+    persistentCaches_.clear();
+    if (!*config_.persistentCache) {
+        // Also the ones of servers used before.
+        thread_->runTask(
+            PersistentCache::removeAllTask(PersistentCacheDirectory));
         return;
     }
+    // Start loading, so it's likely ready on the first lookup.
+    persistentCache(*config_.backend);
+}
+
+PersistentCache *CloudPinyin::persistentCache(CloudPinyinBackend backend) {
+    auto iter = persistentCaches_.find(backend);
+    if (iter == persistentCaches_.end()) {
+        iter = persistentCaches_
+                   .emplace(backend,
+                            std::make_unique<PersistentCache>(
+                                persistentCachePath(backend, server_),
+                                *config_.persistentCacheSize,
+                                *config_.persistentCacheDays * SecondsPerDay))
+                   .first;
+        // Don't block the main thread by reading the file.
+        thread_->runTask(iter->second->loadTask(
+            currentTime(),
+            [&dispatcher = dispatcher_, ref = iter->second->watch()](
+                PersistentCache::Content content) {
+                dispatcher.scheduleWithContext(
+                    ref, [ref, content = std::move(content)]() mutable {
+                        ref.get()->setLoaded(std::move(content));
+                    });
+            }));
+    }
+    return iter->second.get();
+}
+
+void CloudPinyin::savePersistent(CloudPinyinBackend backend,
+                                 const std::string &pinyin,
+                                 const std::vector<std::string> &candidates) {
+    // The option may be turned off while the request is running.
+    if (!*config_.persistentCache) {
+        return;
+    }
+    persistentCache(backend)->insert(pinyin, candidates, currentTime());
+    if (!flushPersistent_->isEnabled()) {
+        flushPersistent_->setNextInterval(PersistentFlushDelay);
+        flushPersistent_->setOneShot();
+    }
+}
+
+void CloudPinyin::flushPersistent() {
+    flushPersistent_->setEnabled(false);
+    for (const auto &[_, cache] : persistentCaches_) {
+        if (cache->dirty()) {
+            thread_->runTask(cache->flushTask());
+        }
+    }
+}
+
+bool CloudPinyin::persistAllowed(InputContext *inputContext) const {
+    // Don't leave anything typed in password field on disk, or anything
+    // from an unknown one.
+    return *config_.persistentCache && inputContext &&
+           !inputContext->capabilityFlags().testAny(
+               CapabilityFlag::PasswordOrSensitive);
+}
+
+const std::vector<std::string> *
+CloudPinyin::cachedResult(CloudPinyinBackend backend,
+                          const std::string &pinyin, bool persist) {
     if (auto *value = cache_.find(pinyin)) {
-        callback(pinyin, *value);
-    } else {
-        auto backend = config_.backend.value();
+        return value;
+    }
+    if (persist) {
+        if (const auto *value =
+                persistentCache(backend)->find(pinyin, currentTime())) {
+            return cache_.insert(pinyin, *value);
+        }
+    }
+    return nullptr;
+}
+
+std::deque<CloudPinyinBackend>
+CloudPinyin::backendOrder(CloudPinyinBackend primary) const {
+    std::deque<CloudPinyinBackend> order{primary};
+    if (!*config_.hedgedRequest) {
+        return order;
+    }
+    for (auto backend :
+         {CloudPinyinBackend::Google, CloudPinyinBackend::GoogleCN,
+          CloudPinyinBackend::Baidu}) {
+        if (backend != primary && backends_.contains(backend)) {
+            order.push_back(backend);
+        }
+    }
+    // The configured backend stays the primary one until another backend is
+    // measured to be faster, unmeasured ones are tried last.
+    auto expected = [this, primary](CloudPinyinBackend backend) {
+        auto iter = latency_.find(backend);
+        if (iter != latency_.end()) {
+            return iter->second.mean();
+        }
+        return backend == primary ? 0 : UnknownLatency;
+    };
+    std::stable_sort(order.begin(), order.end(),
+                     [&expected](CloudPinyinBackend lhs,
+                                 CloudPinyinBackend rhs) {
+                         return expected(lhs) < expected(rhs);
+                     });
+    return order;
+}
+
+uint64_t CloudPinyin::hedgeDelay(CloudPinyinBackend backend) const {
+    if (*config_.hedgeDelay > 0) {
+        return static_cast<uint64_t>(*config_.hedgeDelay) * 1000;
+    }
+    auto iter = latency_.find(backend);
+    if (iter == latency_.end()) {
+        return DefaultHedgeDelay;
+    }
+    return std::clamp(iter->second.p90(), MinHedgeDelay, MaxHedgeDelay);
+}
+
+bool CloudPinyin::startRequest(const PendingKey &key, bool persist,
+                               FetchPriority priority) {
+    PendingRequest request;
+    request.backends = backendOrder(key.first);
+    request.persist = persist;
+    request.priority = priority;
+    if (!startAttempt(key, request)) {
+        return false;
+    }
+    auto &pending = pending_[key] = std::move(request);
+    // Prefetch is not urgent, and limited by the budget.
+    if (pending.backends.empty() || priority != FetchPriority::Foreground) {
+        return true;
+    }
+    pending.hedgeTimer = eventLoop_->addTimeEvent(
+        CLOCK_MONOTONIC,
+        now(CLOCK_MONOTONIC) + hedgeDelay(pending.attempts.front().backend),
+        0, [this, key](EventSourceTime *, uint64_t) {
+            auto iter = pending_.find(key);
+            if (iter != pending_.end()) {
+                CLOUDPINYIN_DEBUG() << "Hedge request: " << key.second;
+                startAttempt(key, iter->second);
+            }
+            return true;
+        });
+    return true;
+}
+
+bool CloudPinyin::startAttempt(const PendingKey &key,
+                               PendingRequest &request) {
+    while (!request.backends.empty()) {
+        const auto backend = request.backends.front();
+        request.backends.pop_front();
         auto iter = backends_.find(backend);
-        if (iter == backends_.end() || errorCount_ >= MAX_ERROR) {
-            callback(pinyin, "");
-            return;
+        if (iter == backends_.end() ||
+            !health_[backend].breaker.allowRequest(now(CLOCK_MONOTONIC))) {
+            continue;
         }
         auto *b = iter->second.get();
-        if (!thread_->addRequest([proxy = *config_.proxy, b, &pinyin,
-                                  &callback](CurlQueue *queue) {
-                if (!b->prepareRequest(queue, pinyin)) {
+        auto token = thread_->addRequest(
+            [this, proxy = *config_.proxy, b, &key,
+             backend](CurlQueue *queue) {
+                if (!b->prepareRequest(queue, key.second)) {
                     return false;
                 }
-                if (curl_easy_setopt(
-                        queue->curl(), CURLOPT_PROXY,
-                        (proxy.empty() ? nullptr : proxy.data())) != CURLE_OK) {
+                if (!queue->setProxy(proxy)) {
                     return false;
                 }
-                queue->setPinyin(pinyin);
+                queue->setPinyin(key.second);
                 queue->setBusy();
-                queue->setCallback(callback);
+                queue->setCallback([this, key, backend,
+                                    start = now(CLOCK_MONOTONIC)](
+                                       CurlQueue *queue) {
+                    attemptFinished(key, backend, start, queue);
+                });
                 return true;
-            })) {
-            callback(pinyin, "");
+            },
+            request.priority);
+        if (token) {
+            request.attempts.push_back({.backend = backend, .token = token});
+            return true;
         }
     }
+    return false;
 }
 
-void CloudPinyin::notifyFinished() {
-    dispatcher_.scheduleWithContext(this->watch(), [this]() {
-        CurlQueue *item;
-        auto backend = config_.backend.value();
-        auto iter = backends_.find(backend);
-        Backend *b = nullptr;
-        if (iter != backends_.end()) {
-            b = iter->second.get();
+void CloudPinyin::recordResult(CloudPinyinBackend backend,
+                               FetchFailure failure) {
+    auto &health = health_[backend];
+    if (failure == FetchFailure::None) {
+        health.successes += 1;
+    } else {
+        health.failures[static_cast<size_t>(failure)] += 1;
+    }
+    // The backend did answer, the pinyin may just have no result.
+    if (failure == FetchFailure::None || failure == FetchFailure::Empty) {
+        if (health.breaker.recordSuccess()) {
+            FCITX_INFO() << "Cloud pinyin backend " << backendName(backend)
+                         << " is back.";
         }
+        return;
+    }
+    if (health.breaker.recordFailure(now(CLOCK_MONOTONIC))) {
+        FCITX_WARN() << "Cloud pinyin backend " << backendName(backend)
+                     << " failed " << health.breaker.failures()
+                     << " times in a row. Retry in "
+                     << (health.breaker.retryTime() - now(CLOCK_MONOTONIC)) /
+                            1000000
+                     << " seconds.";
+    }
+}
+
+std::string CloudPinyin::backendStatus() const {
+    constexpr std::string_view stateNames[] = {"closed", "open", "half open"};
+    constexpr std::string_view failureNames[] = {
+        "none", "dns", "connect", "timeout", "http", "parse", "empty", "other"};
+    static_assert(std::size(failureNames) ==
+                  static_cast<size_t>(FetchFailure::Other) + 1);
+    const auto current = now(CLOCK_MONOTONIC);
+    std::string status;
+    for (auto backend :
+         {CloudPinyinBackend::Google, CloudPinyinBackend::GoogleCN,
+          CloudPinyinBackend::Baidu}) {
+        if (!backends_.contains(backend)) {
+            continue;
+        }
+        auto iter = health_.find(backend);
+        const BackendHealth health =
+            iter == health_.end() ? BackendHealth() : iter->second;
+        status.append(backendName(backend));
+        status.append(": ");
+        status.append(stateNames[static_cast<size_t>(
+            health.breaker.state(current))]);
+        status.append(" success=");
+        status.append(std::to_string(health.successes));
+        for (size_t i = 1; i < health.failures.size(); i++) {
+            status.push_back(' ');
+            status.append(failureNames[i]);
+            status.push_back('=');
+            status.append(std::to_string(health.failures[i]));
+        }
+        status.push_back('\n');
+    }
+    return status;
+}
 
-        while ((item = thread_->popFinished())) {
-            if (item->httpCode() != 200) {
-                errorCount_ += 1;
+void CloudPinyin::attemptFinished(const PendingKey &key,
+                                  CloudPinyinBackend backend, uint64_t start,
+                                  CurlQueue *queue) {
+    auto failure = queue->failure();
+    std::vector<std::string> candidates;
+    if (failure == FetchFailure::None) {
+        if (queue->parsed()) {
+            candidates = queue->candidates();
+        }
+        CLOUDPINYIN_DEBUG() << "Request result: " << candidates;
+        if (!queue->parsed()) {
+            failure = FetchFailure::Parse;
+        } else if (candidates.empty()) {
+            failure = FetchFailure::Empty;
+        }
+    }
+    recordResult(backend, failure);
+    // Failure counts as slow as the timeout, so the backend is only used
+    // as primary again after it does better as the secondary. An empty
+    // result is still an answer, and counts as fast as it is.
+    const bool failed =
+        failure != FetchFailure::None && failure != FetchFailure::Empty;
+    latency_[backend].record(failed ? FailureLatency
+                                    : now(CLOCK_MONOTONIC) - start);
 
-                if (errorCount_ == MAX_ERROR && resetError_) {
-                    FCITX_ERROR() << "Cloud pinyin reaches max error. "
-                                     "Retry in 5 minutes.";
-                    resetError_->setNextInterval(minInUs * 5);
-                    resetError_->setOneShot();
-                }
+    auto iter = pending_.find(key);
+    if (iter != pending_.end()) {
+        auto &request = iter->second;
+        auto attempt = std::ranges::find_if(
+            request.attempts, [queue](const Attempt &attempt) {
+                return attempt.token.queue == queue &&
+                       attempt.token.id == queue->id();
+            });
+        const bool isAttempt = attempt != request.attempts.end();
+        if (isAttempt) {
+            request.attempts.erase(attempt);
+        }
+        if (candidates.empty()) {
+            // Wait for the other one, or try the next backend right away.
+            if (!isAttempt || !request.attempts.empty() ||
+                startAttempt(key, request)) {
+                return;
             }
+        }
+        // First answer wins.
+        for (const auto &attempt : request.attempts) {
+            thread_->cancelRequest(attempt.token);
+        }
+        if (request.persist && !candidates.empty()) {
+            savePersistent(key.first, key.second, candidates);
+        }
+    }
+    // Cache first, callbacks may request the same pinyin again.
+    if (!candidates.empty()) {
+        cache_.insert(key.second, candidates);
+    }
+    finishPending(key, candidates);
+}
 
-            std::string hanzi;
-            if (b) {
-                hanzi = b->parseResult(item);
-            } else {
-                hanzi = "";
+void CloudPinyin::request(const std::string &pinyin,
+                          CloudPinyinCallback callback) {
+    requestCandidates(
+        pinyin, nullptr,
+        [callback = std::move(callback)](
+                    const std::string &pinyin,
+                    const std::vector<std::string> &candidates) {
+            callback(pinyin, candidates.empty() ? "" : candidates.front());
+        });
+}
+
+void CloudPinyin::requestCandidates(const std::string &pinyin,
+                                    InputContext *inputContext,
+                                    CloudPinyinCandidatesCallback callback) {
+    if (static_cast<int>(pinyin.size()) < config_.minimumLength.value()) {
+        callback(pinyin, {});
+        return;
+    }
+    const auto backend = config_.backend.value();
+    const bool persist = persistAllowed(inputContext);
+    if (const auto *value = cachedResult(backend, pinyin, persist)) {
+        // Copy, callback may request again and evict it.
+        const auto candidates = *value;
+        callback(pinyin, candidates);
+        return;
+    }
+    // Same pinyin is usually requested again before the response, e.g.
+    // when the UI is updated, so share the request.
+    PendingKey key(backend, pinyin);
+    if (auto pendingIter = pending_.find(key); pendingIter != pending_.end()) {
+        auto &pending = pendingIter->second;
+        pending.persist = pending.persist && persist;
+        pending.callbacks.push_back(std::move(callback));
+        if (pending.priority == FetchPriority::Background) {
+            promoteRequest(key);
+        }
+        return;
+    }
+    // User has moved on from what is being prefetched.
+    cancelPrefetch();
+    if (!startRequest(key, persist, FetchPriority::Foreground)) {
+        callback(pinyin, {});
+        return;
+    }
+    pending_[key].callbacks.push_back(std::move(callback));
+}
+
+void CloudPinyin::prefetch(const std::string &pinyin,
+                           InputContext *inputContext) {
+    if (static_cast<int>(pinyin.size()) < config_.minimumLength.value()) {
+        return;
+    }
+    // Input context may be gone when it starts.
+    const bool persist = persistAllowed(inputContext);
+    // Same input, e.g. UI update without typing, doesn't delay it more.
+    if (pinyin == prefetchPinyin_ && prefetchTimer_->isEnabled()) {
+        prefetchPersist_ = prefetchPersist_ && persist;
+        return;
+    }
+    if (runningPrefetch_ && runningPrefetch_->second != pinyin) {
+        cancelPrefetch();
+    }
+    prefetchPinyin_ = pinyin;
+    prefetchPersist_ = persist;
+    prefetchTimer_->setNextInterval(PrefetchDelay);
+    prefetchTimer_->setOneShot();
+}
+
+void CloudPinyin::startPrefetch() {
+    const auto current = now(CLOCK_MONOTONIC);
+    while (!prefetchHistory_.empty() &&
+           prefetchHistory_.front() + PrefetchBudgetPeriod <= current) {
+        prefetchHistory_.pop_front();
+    }
+    if (prefetchHistory_.size() >= PrefetchBudget) {
+        prefetchTimer_->setTime(prefetchHistory_.front() +
+                                PrefetchBudgetPeriod);
+        prefetchTimer_->setOneShot();
+        return;
+    }
+
+    const auto backend = config_.backend.value();
+    const bool persist = prefetchPersist_;
+    PendingKey key(backend, std::exchange(prefetchPinyin_, {}));
+    if (cachedResult(backend, key.second, persist) || pending_.contains(key)) {
+        return;
+    }
+    cancelPrefetch();
+    if (!startRequest(key, persist, FetchPriority::Background)) {
+        return;
+    }
+    prefetchHistory_.push_back(current);
+    runningPrefetch_ = std::move(key);
+}
+
+void CloudPinyin::cancelPrefetch() {
+    if (!runningPrefetch_) {
+        return;
+    }
+    const auto key = std::move(*runningPrefetch_);
+    runningPrefetch_.reset();
+    auto iter = pending_.find(key);
+    // Finished already, or someone is waiting for the result now.
+    if (iter == pending_.end() || !iter->second.callbacks.empty()) {
+        return;
+    }
+    for (const auto &attempt : iter->second.attempts) {
+        thread_->cancelRequest(attempt.token);
+    }
+    // Result of a cancelled request is dropped, so the same pinyin can be
+    // requested again right away.
+    pending_.erase(iter);
+}
+
+void CloudPinyin::promoteRequest(const PendingKey &key) {
+    auto node = pending_.extract(key);
+    auto &request = node.mapped();
+    // A prefetch may still wait behind other background requests, and it is
+    // not hedged, so it is started again as a foreground request. A result
+    // of the old one that is already on the way is still taken.
+    for (const auto &attempt : request.attempts) {
+        thread_->cancelRequest(attempt.token);
+    }
+    if (runningPrefetch_ == key) {
+        runningPrefetch_.reset();
+    }
+    if (!startRequest(key, request.persist, FetchPriority::Foreground)) {
+        for (const auto &callback : request.callbacks) {
+            callback(key.second, {});
+        }
+        return;
+    }
+    pending_[key].callbacks = std::move(request.callbacks);
+}
+
+void CloudPinyin::finishPending(const PendingKey &key,
+                                const std::vector<std::string> &candidates) {
+    auto node = pending_.extract(key);
+    if (node.empty()) {
+        return;
+    }
+    // Callback may request again, so it's taken out of pending_ first.
+    for (const auto &callback : node.mapped().callbacks) {
+        callback(key.second, candidates);
+    }
+}
+
+void CloudPinyin::notifyFinished() {
+    dispatcher_.scheduleWithContext(this->watch(), [this]() {
+        thread_->drainFinished([this](CurlQueue *item) {
+            if (item->cancelled()) {
+                thread_->releaseRequest(item);
+                return;
             }
-            item->callback()(item->pinyin(), hanzi);
-            if (!hanzi.empty()) {
-                cache_.insert(item->pinyin(), hanzi);
+            if (metrics_.record(*item)) {
+                CLOUDPINYIN_DEBUG()
+                    << "Requests: " << metrics_.requests()
+                    << " connection reuse: " << metrics_.reuseRate()
+                    << "% average time to first byte: "
+                    << metrics_.averageTimeToFirstByte() << "us";
             }
-            item->release();
-        }
+            item->callback()(item);
+            thread_->releaseRequest(item);
+        });
         return true;
     });
 }
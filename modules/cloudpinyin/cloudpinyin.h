@@ -7,9 +7,11 @@
 #ifndef _CLOUDPINYIN_CLOUDPINYIN_H_
 #define _CLOUDPINYIN_CLOUDPINYIN_H_
 
+#include "../../common/lrucache.h"
+#include "circuitbreaker.h"
 #include "cloudpinyin_public.h"
 #include "fetch.h"
-#include "lrucache.h"
+#include "persistentcache.h"
 #include <fcitx-config/configuration.h>
 #include <fcitx-config/enum.h>
 #include <fcitx-config/iniparser.h>
@@ -20,6 +22,16 @@
 #include <fcitx/addonfactory.h>
 #include <fcitx/addoninstance.h>
 #include <fcitx/instance.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
 FCITX_CONFIG_ENUM(CloudPinyinBackend, Google, GoogleCN, Baidu);
 FCITX_CONFIGURATION(
@@ -42,14 +54,92 @@ FCITX_CONFIGURATION(
         {},
         {_("The proxy format must be the one that is supported by cURL. "
            "Usually it is in the format of [scheme]://[host]:[port], e.g. "
-           "http://localhost:1080.")}};);
+           "http://localhost:1080.")}};
+    fcitx::OptionWithAnnotation<std::string, fcitx::ToolTipAnnotation> server{
+        this,
+        "Server",
+        _("Server"),
+        "",
+        {},
+        {},
+        {_("Send requests to this server instead of the one of the backend, "
+           "in the format of [scheme]://[host]:[port]. Leave it empty to use "
+           "the default one.")}};
+    fcitx::Option<bool> persistentCache{this, "PersistentCache",
+                                        _("Save results on disk"), true};
+    fcitx::Option<int, fcitx::IntConstrain> persistentCacheSize{
+        this, "PersistentCacheSize", _("Saved results for each backend"),
+        4096, fcitx::IntConstrain(1, 100000)};
+    fcitx::Option<int, fcitx::IntConstrain> persistentCacheDays{
+        this, "PersistentCacheDays", _("Days to keep saved results"), 30,
+        fcitx::IntConstrain(1, 3650)};
+    fcitx::Option<bool> hedgedRequest{this, "HedgedRequest",
+                                      _("Send slow requests to another "
+                                        "backend"),
+                                      false};
+    fcitx::Option<int, fcitx::IntConstrain, fcitx::DefaultMarshaller<int>,
+                  fcitx::ToolTipAnnotation>
+        hedgeDelay{this,
+                   "HedgeDelay",
+                   _("Delay before sending to another backend (ms)"),
+                   0,
+                   fcitx::IntConstrain(0, 10000),
+                   {},
+                   {_("0 means it is decided by the recent latency of the "
+                      "backend.")}};);
 
 class Backend {
 public:
+    // Set the URL and the candidate filter of the queue.
     FCITX_NODISCARD virtual bool prepareRequest(CurlQueue *queue,
                                                 const std::string &pinyin) = 0;
-    virtual std::string parseResult(CurlQueue *queue) = 0;
     virtual ~Backend() = default;
+
+    // Empty means the default server of the backend.
+    void setServer(std::string server) { server_ = std::move(server); }
+
+protected:
+    const std::string &server(const std::string &defaultServer) const {
+        return server_.empty() ? defaultServer : server_;
+    }
+
+private:
+    std::string server_;
+};
+
+// Smoothed latency of a backend, in microseconds.
+class LatencyTracker {
+public:
+    void record(uint64_t latency) {
+        if (!samples_) {
+            mean_ = latency;
+            deviation_ = latency / 2;
+        } else {
+            const uint64_t diff =
+                latency > mean_ ? latency - mean_ : mean_ - latency;
+            // Same weights as TCP retransmission timeout (RFC 6298).
+            deviation_ = (deviation_ * 3 + diff) / 4;
+            mean_ = (mean_ * 7 + latency) / 8;
+        }
+        samples_ += 1;
+    }
+
+    uint64_t mean() const { return mean_; }
+    // Rough 90th percentile, assuming latency is normally distributed.
+    uint64_t p90() const { return mean_ + deviation_ * 8 / 5; }
+
+private:
+    uint64_t mean_ = 0;
+    uint64_t deviation_ = 0;
+    uint64_t samples_ = 0;
+};
+
+struct BackendHealth {
+    CircuitBreaker breaker;
+    uint64_t successes = 0;
+    // Indexed by FetchFailure.
+    std::array<uint64_t, static_cast<size_t>(FetchFailure::Other) + 1>
+        failures{};
 };
 
 class CloudPinyin : public fcitx::AddonInstance,
@@ -63,34 +153,110 @@ public:
     void setConfig(const fcitx::RawConfig &config) override {
         config_.load(config, true);
         fcitx::safeSaveAsIni(config_, "conf/cloudpinyin.conf");
+        populateConfig();
     }
 
     void request(const std::string &pinyin, CloudPinyinCallback callback);
+    void requestCandidates(const std::string &pinyin,
+                           fcitx::InputContext *inputContext,
+                           CloudPinyinCandidatesCallback callback);
+    void prefetch(const std::string &pinyin,
+                  fcitx::InputContext *inputContext);
     const fcitx::KeyList &toggleKey() const {
         return config_.toggleKey.value();
     }
     void resetError() {
-        errorCount_ = 0;
-        resetError_->setEnabled(false);
+        for (auto &[_, health] : health_) {
+            health.breaker.reset();
+        }
     }
+    std::string backendStatus() const;
 
+    // Call from fetch thread when the first request is added to the empty
+    // finishing queue.
     void notifyFinished();
 
 private:
+    using PendingKey = std::pair<CloudPinyinBackend, std::string>;
+
+    struct Attempt {
+        CloudPinyinBackend backend;
+        FetchToken token;
+    };
+
+    struct PendingRequest {
+        std::vector<CloudPinyinCandidatesCallback> callbacks;
+        std::vector<Attempt> attempts;
+        // Backends to try if the running ones are slow or fail.
+        std::deque<CloudPinyinBackend> backends;
+        std::unique_ptr<fcitx::EventSourceTime> hedgeTimer;
+        bool persist = false;
+        FetchPriority priority = FetchPriority::Foreground;
+    };
+
+    bool persistAllowed(fcitx::InputContext *inputContext) const;
+    const std::vector<std::string> *cachedResult(CloudPinyinBackend backend,
+                                                 const std::string &pinyin,
+                                                 bool persist);
+    std::deque<CloudPinyinBackend>
+    backendOrder(CloudPinyinBackend primary) const;
+    uint64_t hedgeDelay(CloudPinyinBackend backend) const;
+    bool startRequest(const PendingKey &key, bool persist,
+                      FetchPriority priority);
+    bool startAttempt(const PendingKey &key, PendingRequest &request);
+    void recordResult(CloudPinyinBackend backend, FetchFailure failure);
+    void attemptFinished(const PendingKey &key, CloudPinyinBackend backend,
+                         uint64_t start, CurlQueue *queue);
+    // Restart a background request that someone is waiting for now.
+    void promoteRequest(const PendingKey &key);
+    void finishPending(const PendingKey &key,
+                       const std::vector<std::string> &candidates);
+    void startPrefetch();
+    void cancelPrefetch();
+    void populateConfig();
+    PersistentCache *persistentCache(CloudPinyinBackend backend);
+    void savePersistent(CloudPinyinBackend backend, const std::string &pinyin,
+                        const std::vector<std::string> &candidates);
+    void flushPersistent();
+
     FCITX_ADDON_EXPORT_FUNCTION(CloudPinyin, request);
+    FCITX_ADDON_EXPORT_FUNCTION(CloudPinyin, requestCandidates);
+    FCITX_ADDON_EXPORT_FUNCTION(CloudPinyin, prefetch);
     FCITX_ADDON_EXPORT_FUNCTION(CloudPinyin, toggleKey);
     FCITX_ADDON_EXPORT_FUNCTION(CloudPinyin, resetError);
+    FCITX_ADDON_EXPORT_FUNCTION(CloudPinyin, backendStatus);
     std::unique_ptr<FetchThread> thread_;
+    fcitx::Instance *instance_;
     fcitx::EventLoop *eventLoop_;
     fcitx::EventDispatcher &dispatcher_;
     std::unique_ptr<fcitx::EventSourceIO> event_;
-    std::unique_ptr<fcitx::EventSourceTime> resetError_;
-    LRUCache<std::string, std::string> cache_{2048};
+    std::unique_ptr<fcitx::EventSourceTime> flushPersistent_;
+    std::unique_ptr<fcitx::EventSourceTime> prefetchTimer_;
+    // Waiting for the debounce or the budget.
+    std::string prefetchPinyin_;
+    bool prefetchPersist_ = false;
+    // Start time of recent prefetch requests.
+    std::deque<uint64_t> prefetchHistory_;
+    // Cancelled if user moves on before anyone asks for it.
+    std::optional<PendingKey> runningPrefetch_;
+    LRUCache<std::string, std::vector<std::string>> cache_{2048};
+    // Requests that are running, the key is the configured backend.
+    std::map<PendingKey, PendingRequest> pending_;
     std::unordered_map<CloudPinyinBackend, std::unique_ptr<Backend>,
                        fcitx::EnumHash>
         backends_;
+    // Loaded on first use, and written by the fetch thread.
+    std::unordered_map<CloudPinyinBackend, std::unique_ptr<PersistentCache>,
+                       fcitx::EnumHash>
+        persistentCaches_;
+    std::unordered_map<CloudPinyinBackend, LatencyTracker, fcitx::EnumHash>
+        latency_;
+    std::unordered_map<CloudPinyinBackend, BackendHealth, fcitx::EnumHash>
+        health_;
     CloudPinyinConfig config_;
-    int errorCount_ = 0;
+    // Server of the cached results.
+    std::string server_;
+    FetchMetrics metrics_;
 };
 
 class CloudPinyinFactory : public fcitx::AddonFactory {
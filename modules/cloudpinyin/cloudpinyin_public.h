@@ -7,7 +7,9 @@
 #ifndef _CLOUDPINYIN_CLOUDPINYIN_PUBLIC_H_
 #define _CLOUDPINYIN_CLOUDPINYIN_PUBLIC_H_
 
+#include <algorithm>
 #include <chrono>
+#include <cstddef>
 #include <fcitx-utils/key.h>
 #include <fcitx-utils/macros.h>
 #include <fcitx-utils/trackableobject.h>
@@ -18,22 +20,68 @@
 #include <fcitx/text.h>
 #include <fcitx/userinterface.h>
 #include <functional>
+#include <memory>
 #include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
 using CloudPinyinCallback =
     std::function<void(const std::string &pinyin, const std::string &hanzi)>;
 
+// Candidates are ranked, the best one first, empty if it fails.
+using CloudPinyinCandidatesCallback =
+    std::function<void(const std::string &pinyin,
+                       const std::vector<std::string> &candidates)>;
+
 using CloudPinyinSelectedCallback =
     std::function<void(fcitx::InputContext *inputContext,
                        const std::string &selected, const std::string &word)>;
 
+// Only the best candidate is returned. The result is not kept on disk,
+// since the input context is unknown.
 FCITX_ADDON_DECLARE_FUNCTION(CloudPinyin, request,
                              void(const std::string &pinyin,
                                   CloudPinyinCallback));
+// Input context decides whether the result can be kept on disk.
+FCITX_ADDON_DECLARE_FUNCTION(CloudPinyin, requestCandidates,
+                             void(const std::string &pinyin,
+                                  fcitx::InputContext *inputContext,
+                                  CloudPinyinCandidatesCallback));
+// Request pinyin in background once user stops typing for a while, so the
+// result is likely cached when it's requested.
+FCITX_ADDON_DECLARE_FUNCTION(CloudPinyin, prefetch,
+                             void(const std::string &pinyin,
+                                  fcitx::InputContext *inputContext));
 FCITX_ADDON_DECLARE_FUNCTION(CloudPinyin, toggleKey, const fcitx::KeyList &());
+// Close the circuit breaker of all backends, e.g. user turns it on again.
 FCITX_ADDON_DECLARE_FUNCTION(CloudPinyin, resetError, void());
+// One line for each backend, with the breaker state and failure counts.
+FCITX_ADDON_DECLARE_FUNCTION(CloudPinyin, backendStatus, std::string());
+
+// Cloud pinyin candidate after the first one.
+class CloudPinyinExtraCandidateWord : virtual public fcitx::CandidateWord {
+public:
+    CloudPinyinExtraCandidateWord(std::string word,
+                                  std::string selectedSentence,
+                                  CloudPinyinSelectedCallback callback)
+        : word_(std::move(word)),
+          selectedSentence_(std::move(selectedSentence)),
+          callback_(std::move(callback)) {
+        setText(fcitx::Text(word_));
+    }
+
+    void select(fcitx::InputContext *inputContext) const override {
+        callback_(inputContext, selectedSentence_, word_);
+    }
+
+    const std::string &word() const { return word_; }
+
+private:
+    std::string word_;
+    std::string selectedSentence_;
+    CloudPinyinSelectedCallback callback_;
+};
 
 class CloudPinyinCandidateWord
     : virtual public fcitx::CandidateWord,
@@ -43,19 +91,21 @@ public:
                              const std::string &pinyin,
                              std::string selectedSentence, bool keep,
                              fcitx::InputContext *inputContext,
-                             CloudPinyinSelectedCallback callback)
+                             CloudPinyinSelectedCallback callback,
+                             size_t limit = 1)
         : selectedSentence_(std::move(selectedSentence)),
           inputContext_(inputContext), callback_(std::move(callback)),
-          keep_(keep) {
+          keep_(keep), limit_(limit) {
         // use cloud unicode char
         setText(fcitx::Text("\xe2\x98\x81"));
-        cloudpinyin_->call<fcitx::ICloudPinyin::request>(
-            pinyin, [ref = watch()](const std::string &pinyin,
-                                    const std::string &hanzi) {
+        cloudpinyin_->call<fcitx::ICloudPinyin::requestCandidates>(
+            pinyin, inputContext,
+            [ref = watch()](const std::string &pinyin,
+                            const std::vector<std::string> &candidates) {
                 FCITX_UNUSED(pinyin);
                 auto *self = ref.get();
                 if (self) {
-                    self->fill(hanzi);
+                    self->fill(candidates);
                 }
             });
         constructor_ = false;
@@ -71,14 +121,31 @@ public:
 
     bool filled() const { return filled_; }
     const std::string &word() const { return word_; }
+    // Up to limit candidates, the first one is word().
+    const std::vector<std::string> &candidates() const { return candidates_; }
+    const std::string &selectedSentence() const { return selectedSentence_; }
+    const CloudPinyinSelectedCallback &callback() const { return callback_; }
     fcitx::InputContext *inputContext() { return inputContext_; }
 
+    // Candidate for one of candidates() after the first one, override it to
+    // add more to it.
+    virtual std::unique_ptr<fcitx::CandidateWord>
+    makeExtraCandidate(const std::string &word) const {
+        return std::make_unique<CloudPinyinExtraCandidateWord>(
+            word, selectedSentence_, callback_);
+    }
+
 private:
     static constexpr long int LOADING_TIME_QUICK_THRESHOLD = 1000;
 
-    void fill(const std::string &hanzi) {
-        setText(fcitx::Text(hanzi));
-        word_ = hanzi;
+    void fill(const std::vector<std::string> &candidates) {
+        candidates_.assign(
+            candidates.begin(),
+            candidates.begin() +
+                static_cast<std::ptrdiff_t>(
+                    std::min(candidates.size(), std::max<size_t>(limit_, 1))));
+        word_ = candidates_.empty() ? std::string() : candidates_.front();
+        setText(fcitx::Text(word_));
         filled_ = true;
         if (!constructor_) {
             update();
@@ -108,6 +175,8 @@ private:
                 }
             }
         }
+        // Where the rest of candidates_ goes, right after the first one.
+        int extraIdx = idx + 1;
         if (idx >= 0 && (dupIndex || word_.empty())) {
             auto ms =
                 std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -123,11 +192,13 @@ private:
                     // result is empty.
                     // Remove empty.
                     modifiable->remove(0);
+                    extraIdx = 0;
                 }
 
             } else {
                 if (!keep_ && ms <= LOADING_TIME_QUICK_THRESHOLD) {
                     modifiable->remove(idx);
+                    extraIdx = idx;
                 } else {
                     setText(fcitx::Text("\xe2\x98\x81"));
                     word_ = std::string();
@@ -135,20 +206,40 @@ private:
                 }
             }
         }
+        // The rest are still shown if the first one is a duplicate.
+        if (idx >= 0) {
+            insertExtraCandidates(modifiable, extraIdx);
+        }
         // use stack variable inputContext, because it may be removed already
         inputContext->updateUserInterface(
             fcitx::UserInterfaceComponent::InputPanel);
     }
 
+    void insertExtraCandidates(fcitx::ModifiableCandidateList *modifiable,
+                               int idx) {
+        for (size_t i = 1; i < candidates_.size(); i++) {
+            bool dup = false;
+            for (auto j = 0, e = modifiable->totalSize(); j < e && !dup; j++) {
+                dup = modifiable->candidateFromAll(j).text().toString() ==
+                      candidates_[i];
+            }
+            if (!dup) {
+                modifiable->insert(idx++, makeExtraCandidate(candidates_[i]));
+            }
+        }
+    }
+
     std::chrono::high_resolution_clock::time_point timestamp_ =
         std::chrono::high_resolution_clock::now();
     bool filled_ = false;
     std::string word_;
+    std::vector<std::string> candidates_;
     std::string selectedSentence_;
     fcitx::InputContext *inputContext_;
     bool constructor_ = true;
     CloudPinyinSelectedCallback callback_;
     bool keep_;
+    size_t limit_;
 };
 
 #endif // _CLOUDPINYIN_CLOUDPINYIN_PUBLIC_H_
@@ -0,0 +1,83 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _CLOUDPINYIN_COMPLETIONQUEUE_H_
+#define _CLOUDPINYIN_COMPLETIONQUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+class CompletionQueueNode {
+    template <typename T>
+    friend class CompletionQueue;
+
+    CompletionQueueNode *completionNext_ = nullptr;
+};
+
+/**
+ * Lock-free queue with many producers and a single consumer.
+ *
+ * Producers push onto a stack with compare and swap, and the consumer takes
+ * the whole stack at once and reverses it, so items are still handled in
+ * the order they are pushed. Only the push onto an empty queue asks for a
+ * wakeup, later ones are handled by the same drain.
+ *
+ * An item must not be pushed again before the drain reaches it.
+ */
+template <typename T>
+class CompletionQueue {
+    static_assert(std::is_base_of_v<CompletionQueueNode, T>);
+
+public:
+    // Call from any thread. Return true if the queue was empty, and the
+    // consumer needs to be woken up.
+    bool push(T *item) {
+        CompletionQueueNode *node = item;
+        CompletionQueueNode *head = head_.load(std::memory_order_relaxed);
+        do {
+            node->completionNext_ = head;
+        } while (!head_.compare_exchange_weak(head, node,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed));
+        return head == nullptr;
+    }
+
+    // Call from consumer thread. Callback may push the item again, or push
+    // other items which are handled by the next drain. Return the number
+    // of items.
+    template <typename Callback>
+    size_t drain(Callback &&callback) {
+        CompletionQueueNode *node =
+            head_.exchange(nullptr, std::memory_order_acquire);
+        CompletionQueueNode *reversed = nullptr;
+        while (node) {
+            auto *next = node->completionNext_;
+            node->completionNext_ = reversed;
+            reversed = node;
+            node = next;
+        }
+        size_t count = 0;
+        while (reversed) {
+            // Item may be reused once callback returns.
+            auto *next = reversed->completionNext_;
+            reversed->completionNext_ = nullptr;
+            callback(static_cast<T *>(reversed));
+            reversed = next;
+            count += 1;
+        }
+        return count;
+    }
+
+    bool empty() const {
+        return head_.load(std::memory_order_relaxed) == nullptr;
+    }
+
+private:
+    std::atomic<CompletionQueueNode *> head_ = nullptr;
+};
+
+#endif // _CLOUDPINYIN_COMPLETIONQUEUE_H_
@@ -6,6 +6,7 @@
  */
 #include "fetch.h"
 #include "cloudpinyin.h"
+#include <cstddef>
 #include <cstdint>
 #include <curl/curl.h>
 #include <curl/multi.h>
@@ -15,10 +16,12 @@
 #include <fcitx-utils/fs.h>
 #include <fcitx-utils/macros.h>
 #include <fcntl.h>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <thread>
 #include <unistd.h>
+#include <utility>
 
 using namespace fcitx;
 
@@ -31,6 +34,24 @@ FetchThread::FetchThread(CloudPinyin *cloudPinyin) : cloudPinyin_(cloudPinyin) {
     curl_multi_setopt(curlm_, CURLMOPT_TIMERFUNCTION,
                       &FetchThread::curlTimerCallback);
     curl_multi_setopt(curlm_, CURLMOPT_TIMERDATA, this);
+    curl_multi_setopt(curlm_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+    curlsh_ = curl_share_init();
+    if (curlsh_) {
+        curl_share_setopt(curlsh_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(curlsh_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+        curl_share_setopt(curlsh_, CURLSHOPT_SHARE,
+                          CURL_LOCK_DATA_SSL_SESSION);
+        for (auto &handle : handles_) {
+            curl_easy_setopt(handle.curl(), CURLOPT_SHARE, curlsh_);
+        }
+    }
+
+    // In reverse, so handles are taken in order.
+    freeHandles_.reserve(MAX_HANDLE);
+    for (auto i = MAX_HANDLE; i > 0; i--) {
+        freeHandles_.push_back(&handles_[i - 1]);
+    }
 
     thread_ = std::make_unique<std::thread>(&FetchThread::runThread, this);
 }
@@ -45,18 +66,23 @@ FetchThread::~FetchThread() {
         curl_multi_remove_handle(curlm_, queue->curl());
         queue->release();
     }
-    while (!pendingQueue.empty()) {
-        auto *queue = &pendingQueue.front();
-        pendingQueue.pop_front();
-        queue->release();
-    }
-    while (!finishingQueue.empty()) {
-        auto *queue = &finishingQueue.front();
-        finishingQueue.pop_front();
-        queue->release();
+    for (auto *list : {&pendingQueue, &pendingBackgroundQueue}) {
+        while (!list->empty()) {
+            auto *queue = &list->front();
+            list->pop_front();
+            queue->release();
+        }
     }
+    finishingQueue.drain([](CurlQueue *queue) { queue->release(); });
 
     curl_multi_cleanup(curlm_);
+    // Share handle can only be cleaned up once no handle uses it.
+    if (curlsh_) {
+        for (auto &handle : handles_) {
+            curl_easy_setopt(handle.curl(), CURLOPT_SHARE, nullptr);
+        }
+        curl_share_cleanup(curlsh_);
+    }
 }
 
 void FetchThread::runThread(FetchThread *self) { self->run(); }
@@ -98,13 +124,23 @@ void FetchThread::processMessages() {
             void *p = nullptr;
             curl_easy_getinfo(curl_message->easy_handle, CURLINFO_PRIVATE, &p);
             auto *queue = static_cast<CurlQueue *>(p);
-            curl_multi_remove_handle(curlm_, queue->curl());
+            stopWorking(queue);
             queue->finish(curl_message->data.result);
-            queue->remove();
             finished(queue);
         }
         curl_message = curl_multi_info_read(curlm_, &num_messages);
     }
+    // Background requests may wait for a free slot.
+    handlePendingRequests();
+}
+
+void FetchThread::stopWorking(CurlQueue *queue) {
+    curl_multi_remove_handle(curlm_, queue->curl());
+    queue->setWorking(false);
+    queue->remove();
+    if (queue->priority() == FetchPriority::Background) {
+        backgroundWorking_ -= 1;
+    }
 }
 
 int FetchThread::curl(curl_socket_t s, int action) {
@@ -181,34 +217,79 @@ void FetchThread::curlTimer(long timeout_ms) {
 }
 
 void FetchThread::finished(CurlQueue *queue) {
-    {
-        const std::lock_guard<std::mutex> lock(finishQueueLock);
-        finishingQueue.push_back(*queue);
+    // Main thread drains everything finished so far once woken up.
+    if (finishingQueue.push(queue)) {
+        cloudPinyin_->notifyFinished();
     }
-    cloudPinyin_->notifyFinished();
 }
 
-bool FetchThread::addRequest(const SetupRequestCallback &callback) {
-    CurlQueue *queue = nullptr;
-    for (auto &handle : handles_) {
-        if (!handle.busy()) {
-            queue = &handle;
-            break;
-        }
+FetchToken FetchThread::addRequest(const SetupRequestCallback &callback,
+                                   FetchPriority priority) {
+    const size_t reserved = priority == FetchPriority::Background
+                                ? ReservedForegroundHandles
+                                : 0;
+    if (freeHandles_.size() <= reserved) {
+        return {};
     }
-    if (!queue) {
-        return false;
+    auto *queue = freeHandles_.back();
+    if (!callback(queue)) {
+        queue->release();
+        return {};
     }
-    callback(queue);
+    freeHandles_.pop_back();
+    const uint64_t id = ++nextId_;
+    queue->setId(id);
+    queue->setPriority(priority);
+    // Share the connection with foreground requests first.
+    curl_easy_setopt(queue->curl(), CURLOPT_STREAM_WEIGHT,
+                     priority == FetchPriority::Background ? 16L : 256L);
 
     {
         const std::lock_guard<std::mutex> lock(pendingQueueLock);
-        pendingQueue.push_back(*queue);
+        queue->setPending(true);
+        if (priority == FetchPriority::Background) {
+            pendingBackgroundQueue.push_back(*queue);
+        } else {
+            pendingQueue.push_back(*queue);
+        }
     }
 
     // Handle pending queue in fetch thread.
     dispatcher_.schedule([this]() { handlePendingRequests(); });
-    return true;
+    return {.queue = queue, .id = id};
+}
+
+void FetchThread::releaseRequest(CurlQueue *queue) {
+    queue->release();
+    freeHandles_.push_back(queue);
+}
+
+void FetchThread::cancelRequest(const FetchToken &token) {
+    dispatcher_.schedule([this, token]() {
+        auto *queue = token.queue;
+        if (queue->id() != token.id) {
+            // Finished and reused already.
+            return;
+        }
+        if (queue->working()) {
+            stopWorking(queue);
+        } else {
+            const std::lock_guard<std::mutex> lock(pendingQueueLock);
+            if (!queue->pending()) {
+                // Finished, but not released yet.
+                return;
+            }
+            queue->setPending(false);
+            queue->remove();
+        }
+        queue->finish(CURLE_ABORTED_BY_CALLBACK);
+        finished(queue);
+        handlePendingRequests();
+    });
+}
+
+void FetchThread::runTask(std::function<void()> task) {
+    dispatcher_.schedule(std::move(task));
 }
 
 void FetchThread::exit() {
@@ -218,24 +299,30 @@ void FetchThread::exit() {
     });
 }
 
-CurlQueue *FetchThread::popFinished() {
-    const std::lock_guard<std::mutex> lock(finishQueueLock);
-    CurlQueue *result = nullptr;
-    if (!finishingQueue.empty()) {
-        result = &finishingQueue.front();
-        finishingQueue.pop_front();
-    }
-    return result;
+size_t FetchThread::drainFinished(
+    const std::function<void(CurlQueue *)> &callback) {
+    return finishingQueue.drain(callback);
 }
 
 void FetchThread::handlePendingRequests() {
     const std::lock_guard<std::mutex> lock(pendingQueueLock);
 
-    while (!pendingQueue.empty()) {
-        auto *queue = &pendingQueue.front();
-        pendingQueue.pop_front();
+    auto startWorking = [this](fcitx::IntrusiveList<CurlQueue> &list) {
+        auto *queue = &list.front();
+        list.pop_front();
+        queue->setPending(false);
         curl_multi_add_handle(curlm_, queue->curl());
+        queue->setWorking(true);
         workingQueue.push_back(*queue);
+    };
+    // Foreground requests are always started right away.
+    while (!pendingQueue.empty()) {
+        startWorking(pendingQueue);
+    }
+    while (!pendingBackgroundQueue.empty() &&
+           backgroundWorking_ < MaxBackgroundWorking) {
+        startWorking(pendingBackgroundQueue);
+        backgroundWorking_ += 1;
     }
 }
 
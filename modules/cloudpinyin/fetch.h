@@ -8,7 +8,10 @@
 #define _CLOUDPINYIN_FETCH_H_
 
 #include "cloudpinyin_public.h"
+#include "completionqueue.h"
+#include "jsontokenizer.h"
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <curl/curl.h>
@@ -19,22 +22,54 @@
 #include <fcitx-utils/eventloopinterface.h>
 #include <fcitx-utils/intrusivelist.h>
 #include <functional>
-#include <iterator>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 #define MAX_HANDLE 100l
-#define MAX_BUFFER_SIZE 2048
 
 class CloudPinyin;
+class CurlQueue;
 
-class CurlQueue : public fcitx::IntrusiveListNode {
+// Invoked on the main thread when the request is finished.
+using FetchCallback = std::function<void(CurlQueue *)>;
+
+enum class FetchPriority {
+    // Someone is waiting for the result.
+    Foreground,
+    // Prefetch, only runs when there are spare handles.
+    Background,
+};
+
+// Why a request failed, Parse is decided by the backend.
+enum class FetchFailure {
+    None,
+    DNS,
+    Connect,
+    Timeout,
+    HTTPStatus,
+    // Response is not valid JSON, e.g. a login page of the network.
+    Parse,
+    // Valid response without any candidate.
+    Empty,
+    Other,
+};
+
+class CurlQueue : public fcitx::IntrusiveListNode,
+                  public CompletionQueueNode {
 public:
+    // Whether a string at path of the response is a candidate.
+    using CandidateFilter = bool (*)(const JsonPath &path);
+
+    static constexpr size_t MaxCandidates = 5;
+    // The response is not kept, this only stops an endless one.
+    static constexpr size_t MaxResponseSize = 64 * 1024;
+
     CurlQueue() : curl_(curl_easy_init()) {
         if (!curl_) {
             throw std::runtime_error("Failed to init CURL handle.");
@@ -52,17 +87,36 @@ public:
         if (!result) {
             throw std::runtime_error("Failed setup CURL handle options.");
         }
+
+        // Optional, older curl may not support them.
+        // Fail fast if server is unreachable, most time is spent on
+        // connecting in that case.
+        curl_easy_setopt(curl_, CURLOPT_CONNECTTIMEOUT_MS, 3000L);
+        // Keep connection alive between typing bursts.
+        curl_easy_setopt(curl_, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(curl_, CURLOPT_TCP_KEEPIDLE, 60L);
+        curl_easy_setopt(curl_, CURLOPT_TCP_KEEPINTVL, 30L);
+        // Multiplex requests over one HTTP/2 connection, and wait for it
+        // instead of opening a new connection.
+        curl_easy_setopt(curl_, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(curl_, CURLOPT_PIPEWAIT, 1L);
     }
 
     ~CurlQueue() override { curl_easy_cleanup(curl_); }
 
     void release() {
         busy_ = false;
-        data_.clear();
+        tokenizer_.reset();
+        filter_ = nullptr;
+        received_ = 0;
+        candidates_.clear();
         pinyin_.clear();
         // make sure lambda is free'd
-        callback_ = CloudPinyinCallback();
+        callback_ = FetchCallback();
         httpCode_ = 0;
+        curlResult_ = CURLE_OK;
+        newConnections_ = 0;
+        timeToFirstByte_ = 0;
     }
 
     const auto &pinyin() const { return pinyin_; }
@@ -72,19 +126,78 @@ public:
     void finish(CURLcode result) {
         curlResult_ = result;
         curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &httpCode_);
+        curl_easy_getinfo(curl_, CURLINFO_NUM_CONNECTS, &newConnections_);
+        curl_easy_getinfo(curl_, CURLINFO_STARTTRANSFER_TIME_T,
+                          &timeToFirstByte_);
+    }
+    bool cancelled() const { return curlResult_ == CURLE_ABORTED_BY_CALLBACK; }
+    FetchFailure failure() const {
+        switch (curlResult_) {
+        case CURLE_OK:
+            return httpCode_ == 200 ? FetchFailure::None
+                                    : FetchFailure::HTTPStatus;
+        case CURLE_COULDNT_RESOLVE_PROXY:
+        case CURLE_COULDNT_RESOLVE_HOST:
+            return FetchFailure::DNS;
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_SSL_CONNECT_ERROR:
+            return FetchFailure::Connect;
+        case CURLE_OPERATION_TIMEDOUT:
+            return FetchFailure::Timeout;
+        default:
+            return FetchFailure::Other;
+        }
     }
 
+    // Identify the request, since the handle is reused.
+    uint64_t id() const { return id_; }
+    void setId(uint64_t id) { id_ = id; }
+
+    FetchPriority priority() const { return priority_; }
+    void setPriority(FetchPriority priority) { priority_ = priority; }
+
+    // Guarded by FetchThread::pendingQueueLock.
+    bool pending() const { return pending_; }
+    void setPending(bool pending) { pending_ = pending; }
+    // Only accessed by fetch thread.
+    bool working() const { return working_; }
+    void setWorking(bool working) { working_ = working; }
+
     bool busy() const { return busy_; }
     void setBusy() { busy_ = true; }
 
-    const std::vector<char> &result() { return data_; }
+    void setCandidateFilter(CandidateFilter filter) { filter_ = filter; }
+    // Candidates in the order of the response, parsed as it arrives.
+    const std::vector<std::string> &candidates() const { return candidates_; }
+    // The whole response is valid JSON.
+    bool parsed() const { return tokenizer_.finished(); }
 
-    CloudPinyinCallback callback() { return callback_; }
-    void setCallback(CloudPinyinCallback callback) {
+    const FetchCallback &callback() const { return callback_; }
+    void setCallback(FetchCallback callback) {
         callback_ = std::move(callback);
     }
 
     auto httpCode() const { return httpCode_; }
+    // 0 if an existing connection is reused.
+    auto newConnections() const { return newConnections_; }
+    // In microseconds.
+    auto timeToFirstByte() const { return timeToFirstByte_; }
+
+    // Return false if failed, proxy is only set again if it's changed.
+    bool setProxy(const std::string &proxy) {
+        if (proxySet_ && proxy == proxy_) {
+            return true;
+        }
+        if (curl_easy_setopt(curl_, CURLOPT_PROXY,
+                             proxy.empty() ? nullptr : proxy.data()) !=
+            CURLE_OK) {
+            proxySet_ = false;
+            return false;
+        }
+        proxy_ = proxy;
+        proxySet_ = true;
+        return true;
+    }
 
 private:
     static size_t curlWriteFunction(char *ptr, size_t size, size_t nmemb,
@@ -107,37 +220,125 @@ private:
             return 0;
         }
 
-        realsize = std::min(SIZE_MAX - data_.size(), realsize);
-
         // make sure we won't be hacked
-        if (data_.size() + realsize > MAX_BUFFER_SIZE) {
+        if (realsize > MaxResponseSize - received_) {
             return 0;
         }
+        received_ += realsize;
 
-        data_.reserve(data_.size() + realsize);
-        std::copy(ptr, ptr + realsize, std::back_inserter(data_));
+        // Error page is not JSON, keep receiving so the status code is
+        // reported instead of a write error.
+        if (!tokenizer_.failed()) {
+            tokenizer_.feed(std::string_view(ptr, realsize));
+        }
         return realsize;
     }
 
+    void addCandidate(const JsonPath &path, std::string_view value,
+                      bool isString) {
+        if (!isString || value.empty() || !filter_ ||
+            candidates_.size() >= MaxCandidates || !filter_(path) ||
+            std::ranges::find(candidates_, value) != candidates_.end()) {
+            return;
+        }
+        candidates_.emplace_back(value);
+    }
+
     bool busy_ = false;
+    FetchPriority priority_ = FetchPriority::Foreground;
+    bool pending_ = false;
+    bool working_ = false;
+    std::atomic<uint64_t> id_ = 0;
     CURL *curl_ = nullptr;
     CURLcode curlResult_ = CURLE_OK;
     long httpCode_ = 0;
-    std::vector<char> data_;
+    long newConnections_ = 0;
+    curl_off_t timeToFirstByte_ = 0;
+    std::string proxy_;
+    bool proxySet_ = false;
+    JsonTokenizer tokenizer_{[this](const JsonPath &path,
+                                    std::string_view value, bool isString) {
+        addCandidate(path, value, isString);
+    }};
+    CandidateFilter filter_ = nullptr;
+    size_t received_ = 0;
+    std::vector<std::string> candidates_;
     std::string pinyin_;
-    CloudPinyinCallback callback_;
+    FetchCallback callback_;
 };
 
 using SetupRequestCallback = std::function<bool(CurlQueue *)>;
 
+// Statistics of finished requests, only accessed by main thread.
+class FetchMetrics {
+public:
+    // Log a summary every LogInterval requests.
+    static constexpr uint64_t LogInterval = 50;
+
+    // Return true if it's time to log a summary. Only successful responses
+    // are counted, a failed request may not have any byte or connection.
+    bool record(const CurlQueue &queue) {
+        if (queue.failure() != FetchFailure::None) {
+            return false;
+        }
+        requests_ += 1;
+        if (queue.newConnections() == 0) {
+            reusedConnections_ += 1;
+        }
+        totalTimeToFirstByte_ += queue.timeToFirstByte();
+        return requests_ % LogInterval == 0;
+    }
+
+    uint64_t requests() const { return requests_; }
+    // In percent.
+    uint64_t reuseRate() const {
+        return requests_ ? reusedConnections_ * 100 / requests_ : 0;
+    }
+    // In microseconds.
+    uint64_t averageTimeToFirstByte() const {
+        return requests_ ? totalTimeToFirstByte_ / requests_ : 0;
+    }
+
+private:
+    uint64_t requests_ = 0;
+    uint64_t reusedConnections_ = 0;
+    uint64_t totalTimeToFirstByte_ = 0;
+};
+
+// Identify a request to cancel, since the handle is reused once the request
+// is finished.
+struct FetchToken {
+    CurlQueue *queue = nullptr;
+    uint64_t id = 0;
+
+    explicit operator bool() const { return queue; }
+};
+
 class FetchThread {
 public:
     FetchThread(CloudPinyin *cloudPinyin);
     ~FetchThread();
 
-    // Call from main thread.
-    bool addRequest(const SetupRequestCallback &callback);
-    CurlQueue *popFinished();
+    // Maximum number of background requests running at the same time.
+    static constexpr size_t MaxBackgroundWorking = 2;
+    // Handles that are only used by foreground requests.
+    static constexpr size_t ReservedForegroundHandles = 10;
+
+    // Call from main thread. Return an empty token if no handle is available
+    // or callback fails.
+    FetchToken addRequest(const SetupRequestCallback &callback,
+                          FetchPriority priority = FetchPriority::Foreground);
+    // Call from main thread, callback is called for each finished request
+    // in order. Return the number of requests.
+    size_t drainFinished(const std::function<void(CurlQueue *)> &callback);
+    // Call from main thread, make the handle of a finished request available
+    // again.
+    void releaseRequest(CurlQueue *queue);
+    // Stop the request if it is not finished yet, it is then finished as
+    // cancelled.
+    void cancelRequest(const FetchToken &token);
+    // Run task in fetch thread, tasks are run in order.
+    void runTask(std::function<void()> task);
 
 private:
     static void runThread(FetchThread *self);
@@ -158,6 +359,7 @@ private:
     void processMessages();
 
     void handlePendingRequests();
+    void stopWorking(CurlQueue *queue);
 
     void run();
     void finished(CurlQueue *queue);
@@ -173,14 +375,22 @@ private:
     std::unique_ptr<fcitx::EventSourceTime> timer_;
 
     CURLM *curlm_;
+    // DNS cache, connections and TLS sessions shared by all handles. Only
+    // used by transfers in fetch thread, so no lock is needed.
+    CURLSH *curlsh_;
+    // Only accessed by main thread.
+    uint64_t nextId_ = 0;
+    std::vector<CurlQueue *> freeHandles_;
+    // Only accessed by fetch thread.
+    size_t backgroundWorking_ = 0;
 
     CurlQueue handles_[MAX_HANDLE];
     fcitx::IntrusiveList<CurlQueue> pendingQueue;
+    fcitx::IntrusiveList<CurlQueue> pendingBackgroundQueue;
     fcitx::IntrusiveList<CurlQueue> workingQueue;
-    fcitx::IntrusiveList<CurlQueue> finishingQueue;
+    CompletionQueue<CurlQueue> finishingQueue;
 
     std::mutex pendingQueueLock;
-    std::mutex finishQueueLock;
 };
 
 #endif // _CLOUDPINYIN_FETCH_H_
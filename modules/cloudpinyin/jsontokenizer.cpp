@@ -0,0 +1,288 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "jsontokenizer.h"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace {
+
+bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+bool isLiteralChar(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+           (c >= 'A' && c <= 'Z') || c == '-' || c == '+' || c == '.';
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+bool isNumber(std::string_view value) {
+    if (value.starts_with('-')) {
+        value.remove_prefix(1);
+    }
+    if (value.empty() || value[0] < '0' || value[0] > '9') {
+        return false;
+    }
+    // Digits, fraction and exponent are not checked in detail.
+    return value.find_first_not_of("0123456789.eE+-") ==
+           std::string_view::npos;
+}
+
+} // namespace
+
+void JsonTokenizer::reset() {
+    state_ = State::Value;
+    path_.clear();
+    value_.clear();
+    isKey_ = false;
+    unicode_ = 0;
+    unicodeDigits_ = 0;
+    highSurrogate_ = 0;
+}
+
+bool JsonTokenizer::feed(std::string_view data) {
+    for (const char c : data) {
+        if (!consume(c)) {
+            state_ = State::Error;
+            value_.clear();
+            return false;
+        }
+    }
+    return state_ != State::Error;
+}
+
+bool JsonTokenizer::append(char c) {
+    if (value_.size() >= MaxValueLength) {
+        return false;
+    }
+    value_.push_back(c);
+    return true;
+}
+
+bool JsonTokenizer::appendCodePoint(uint32_t code) {
+    if (code < 0x80) {
+        return append(static_cast<char>(code));
+    }
+    if (code < 0x800) {
+        return append(static_cast<char>(0xC0 | (code >> 6))) &&
+               append(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+    if (code < 0x10000) {
+        return append(static_cast<char>(0xE0 | (code >> 12))) &&
+               append(static_cast<char>(0x80 | ((code >> 6) & 0x3F))) &&
+               append(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+    return append(static_cast<char>(0xF0 | (code >> 18))) &&
+           append(static_cast<char>(0x80 | ((code >> 12) & 0x3F))) &&
+           append(static_cast<char>(0x80 | ((code >> 6) & 0x3F))) &&
+           append(static_cast<char>(0x80 | (code & 0x3F)));
+}
+
+void JsonTokenizer::endValue() {
+    value_.clear();
+    state_ = path_.empty() ? State::Done : State::AfterValue;
+}
+
+bool JsonTokenizer::endLiteral() {
+    if (value_ != "true" && value_ != "false" && value_ != "null" &&
+        !isNumber(value_)) {
+        return false;
+    }
+    if (callback_) {
+        callback_(path_, value_, false);
+    }
+    endValue();
+    return true;
+}
+
+bool JsonTokenizer::consume(char c) {
+    switch (state_) {
+    case State::Value:
+        if (isSpace(c)) {
+            return true;
+        }
+        if (c == '"') {
+            isKey_ = false;
+            state_ = State::String;
+            return true;
+        }
+        if (c == '[' || c == '{') {
+            if (path_.size() >= MaxDepth) {
+                return false;
+            }
+            path_.emplace_back().object = c == '{';
+            state_ = c == '{' ? State::ObjectStart : State::ArrayStart;
+            return true;
+        }
+        if (isLiteralChar(c)) {
+            state_ = State::Literal;
+            return append(c);
+        }
+        return false;
+    case State::ArrayStart:
+        if (isSpace(c)) {
+            return true;
+        }
+        if (c == ']') {
+            path_.pop_back();
+            endValue();
+            return true;
+        }
+        state_ = State::Value;
+        return consume(c);
+    case State::ObjectStart:
+    case State::Key:
+        if (isSpace(c)) {
+            return true;
+        }
+        if (c == '}' && state_ == State::ObjectStart) {
+            path_.pop_back();
+            endValue();
+            return true;
+        }
+        if (c == '"') {
+            isKey_ = true;
+            state_ = State::String;
+            return true;
+        }
+        return false;
+    case State::Colon:
+        if (isSpace(c)) {
+            return true;
+        }
+        if (c == ':') {
+            state_ = State::Value;
+            return true;
+        }
+        return false;
+    case State::AfterValue: {
+        if (isSpace(c)) {
+            return true;
+        }
+        auto &level = path_.back();
+        if (c == ',') {
+            level.index += 1;
+            state_ = level.object ? State::Key : State::Value;
+            return true;
+        }
+        if (c == (level.object ? '}' : ']')) {
+            path_.pop_back();
+            endValue();
+            return true;
+        }
+        return false;
+    }
+    case State::String:
+        if (c == '\\') {
+            state_ = State::Escape;
+            return true;
+        }
+        if (c == '"') {
+            if (highSurrogate_) {
+                return false;
+            }
+            if (isKey_) {
+                path_.back().key = std::move(value_);
+                value_.clear();
+                state_ = State::Colon;
+                return true;
+            }
+            if (callback_) {
+                callback_(path_, value_, true);
+            }
+            endValue();
+            return true;
+        }
+        if (static_cast<unsigned char>(c) < 0x20 || highSurrogate_) {
+            return false;
+        }
+        return append(c);
+    case State::Escape: {
+        if (c == 'u') {
+            unicode_ = 0;
+            unicodeDigits_ = 0;
+            state_ = State::Unicode;
+            return true;
+        }
+        if (highSurrogate_) {
+            return false;
+        }
+        state_ = State::String;
+        switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+            return append(c);
+        case 'b':
+            return append('\b');
+        case 'f':
+            return append('\f');
+        case 'n':
+            return append('\n');
+        case 'r':
+            return append('\r');
+        case 't':
+            return append('\t');
+        default:
+            return false;
+        }
+    }
+    case State::Unicode: {
+        const int value = hexValue(c);
+        if (value < 0) {
+            return false;
+        }
+        unicode_ = (unicode_ << 4) | static_cast<uint32_t>(value);
+        if (++unicodeDigits_ < 4) {
+            return true;
+        }
+        state_ = State::String;
+        if (highSurrogate_) {
+            if (unicode_ < 0xDC00 || unicode_ > 0xDFFF) {
+                return false;
+            }
+            const uint32_t code =
+                0x10000 + ((highSurrogate_ - 0xD800) << 10) +
+                (unicode_ - 0xDC00);
+            highSurrogate_ = 0;
+            return appendCodePoint(code);
+        }
+        if (unicode_ >= 0xD800 && unicode_ <= 0xDBFF) {
+            highSurrogate_ = unicode_;
+            return true;
+        }
+        if (unicode_ >= 0xDC00 && unicode_ <= 0xDFFF) {
+            return false;
+        }
+        return appendCodePoint(unicode_);
+    }
+    case State::Literal:
+        if (isLiteralChar(c)) {
+            return append(c);
+        }
+        if (!endLiteral()) {
+            return false;
+        }
+        return consume(c);
+    case State::Done:
+        return isSpace(c);
+    case State::Error:
+        return false;
+    }
+    return false;
+}
@@ -0,0 +1,92 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _CLOUDPINYIN_JSONTOKENIZER_H_
+#define _CLOUDPINYIN_JSONTOKENIZER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// One level of the position in the document, key is only set for objects.
+struct JsonPathElement {
+    bool object = false;
+    size_t index = 0;
+    std::string key;
+};
+
+using JsonPath = std::vector<JsonPathElement>;
+
+/**
+ * Incremental JSON tokenizer.
+ *
+ * Data can be fed in pieces of any size, and each scalar value is reported
+ * with its path once it is complete. Only the value being parsed and the
+ * path are kept in memory, so the size of the document is not limited.
+ * Numbers and literals are checked loosely, and a scalar at the top level
+ * is only reported once something follows it.
+ */
+class JsonTokenizer {
+public:
+    // Called for each string, number, true, false and null.
+    using ValueCallback = std::function<void(
+        const JsonPath &path, std::string_view value, bool isString)>;
+
+    static constexpr size_t MaxValueLength = 4096;
+    static constexpr size_t MaxDepth = 64;
+
+    explicit JsonTokenizer(ValueCallback callback = {})
+        : callback_(std::move(callback)) {}
+
+    void setCallback(ValueCallback callback) {
+        callback_ = std::move(callback);
+    }
+
+    // Return false if the data is not valid JSON, the rest is ignored.
+    bool feed(std::string_view data);
+    // A complete value is parsed.
+    bool finished() const { return state_ == State::Done; }
+    bool failed() const { return state_ == State::Error; }
+    void reset();
+
+private:
+    enum class State {
+        Value,
+        ArrayStart,
+        ObjectStart,
+        Key,
+        Colon,
+        AfterValue,
+        String,
+        Escape,
+        Unicode,
+        Literal,
+        Done,
+        Error,
+    };
+
+    bool consume(char c);
+    bool append(char c);
+    bool appendCodePoint(uint32_t code);
+    bool endLiteral();
+    void endValue();
+
+    ValueCallback callback_;
+    State state_ = State::Value;
+    JsonPath path_;
+    std::string value_;
+    bool isKey_ = false;
+    uint32_t unicode_ = 0;
+    int unicodeDigits_ = 0;
+    // High surrogate waiting for the low one.
+    uint32_t highSurrogate_ = 0;
+};
+
+#endif // _CLOUDPINYIN_JSONTOKENIZER_H_
@@ -0,0 +1,229 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "persistentcache.h"
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <fcitx-utils/fs.h>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/standardpaths.h>
+#include <fcitx-utils/stringutils.h>
+#include <fcitx-utils/unixfd.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <ios>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Tab and new line are used by the file format.
+bool isStorable(std::string_view value) {
+    return !value.empty() && value.find_first_of("\t\n") == std::string::npos;
+}
+
+std::filesystem::path fullPath(const std::filesystem::path &path) {
+    return fcitx::StandardPaths::global().userDirectory(
+               fcitx::StandardPathsType::PkgData) /
+           path;
+}
+
+bool writeAll(int fd, const std::string &content) {
+    return fcitx::fs::safeWrite(fd, content.data(), content.size()) ==
+           static_cast<ssize_t>(content.size());
+}
+
+} // namespace
+
+PersistentCache::PersistentCache(std::filesystem::path path, size_t size,
+                                 int64_t ttl)
+    : path_(std::move(path)), ttl_(ttl),
+      entries_(std::max<size_t>(size, 1)) {}
+
+std::function<void()>
+PersistentCache::loadTask(int64_t now,
+                          std::function<void(Content)> callback) const {
+    return [path = path_, ttl = ttl_, now, callback = std::move(callback)]() {
+        const auto file = fullPath(path);
+        Content content;
+        // Size of the complete lines.
+        uintmax_t size = 0;
+        bool partial = false;
+        {
+            std::ifstream in(file, std::ios::in | std::ios::binary);
+            std::string line;
+            while (std::getline(in, line)) {
+                if (in.eof()) {
+                    partial = true;
+                    break;
+                }
+                size += line.size() + 1;
+                content.lines += 1;
+                const auto first = line.find('\t');
+                const auto second = line.find('\t', first + 1);
+                if (first == std::string::npos ||
+                    second == std::string::npos) {
+                    continue;
+                }
+                int64_t time = 0;
+                const auto result =
+                    std::from_chars(line.data(), line.data() + first, time);
+                if (result.ec != std::errc() ||
+                    result.ptr != line.data() + first || now - time > ttl) {
+                    continue;
+                }
+                auto candidates = fcitx::stringutils::split(
+                    std::string_view(line).substr(second + 1), "\t",
+                    fcitx::stringutils::SplitBehavior::SkipEmpty);
+                if (candidates.empty()) {
+                    continue;
+                }
+                content.entries.emplace_back(
+                    line.substr(first + 1, second - first - 1),
+                    Entry{std::move(candidates), time});
+            }
+        }
+        // Previous run may stop in the middle of a line, drop it so new
+        // lines are not appended to it.
+        if (partial) {
+            std::error_code ec;
+            std::filesystem::resize_file(file, size, ec);
+        }
+        callback(std::move(content));
+    };
+}
+
+void PersistentCache::setLoaded(Content content) {
+    if (loaded_) {
+        return;
+    }
+    loaded_ = true;
+    std::vector<std::pair<std::string, Entry>> newer;
+    entries_.foreach([&newer](const std::string &pinyin, const Entry &entry) {
+        newer.emplace_back(pinyin, entry);
+    });
+    for (auto *entries : {&content.entries, &newer}) {
+        for (auto &[pinyin, entry] : *entries) {
+            entries_.erase(pinyin);
+            entries_.insert(pinyin, std::move(entry));
+        }
+    }
+    logSize_ += content.lines;
+    if (logSize_ >= 2 * entries_.capacity()) {
+        compact_ = true;
+    }
+}
+
+const std::vector<std::string> *
+PersistentCache::find(const std::string &pinyin, int64_t now) {
+    if (!loaded_) {
+        return nullptr;
+    }
+    auto *entry = entries_.find(pinyin);
+    if (!entry) {
+        return nullptr;
+    }
+    if (now - entry->time > ttl_) {
+        entries_.erase(pinyin);
+        return nullptr;
+    }
+    return &entry->candidates;
+}
+
+void PersistentCache::insert(const std::string &pinyin,
+                             const std::vector<std::string> &candidates,
+                             int64_t now) {
+    if (!isStorable(pinyin) || candidates.empty() ||
+        !std::ranges::all_of(candidates, isStorable)) {
+        return;
+    }
+    entries_.erase(pinyin);
+    append(pinyin, *entries_.insert(pinyin, Entry{candidates, now}));
+    logSize_ += 1;
+    // Rewriting before loading would drop the entries in the file.
+    if (loaded_ && logSize_ >= 2 * entries_.capacity()) {
+        compact_ = true;
+    }
+}
+
+void PersistentCache::append(const std::string &pinyin, const Entry &entry) {
+    pending_.append(std::to_string(entry.time));
+    pending_.push_back('\t');
+    pending_.append(pinyin);
+    for (const auto &candidate : entry.candidates) {
+        pending_.push_back('\t');
+        pending_.append(candidate);
+    }
+    pending_.push_back('\n');
+}
+
+std::function<void()> PersistentCache::flushTask() {
+    if (!compact_) {
+        return [path = path_, content = std::exchange(pending_, {})]() {
+            if (content.empty()) {
+                return;
+            }
+            const auto file = fullPath(path);
+            fcitx::fs::makePath(file.parent_path());
+            const auto fd = fcitx::UnixFD::own(
+                ::open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                       0600));
+            if (!fd.isValid() || !writeAll(fd.fd(), content)) {
+                FCITX_ERROR() << "Failed to write cloud pinyin cache " << file;
+            }
+        };
+    }
+
+    // Write all entries from the least recently used one, so the order is
+    // the same after loading it again.
+    pending_.clear();
+    entries_.foreach([this](const std::string &pinyin, const Entry &entry) {
+        append(pinyin, entry);
+    });
+    logSize_ = entries_.size();
+    compact_ = false;
+    return [path = path_, content = std::exchange(pending_, {})]() {
+        if (!fcitx::StandardPaths::global().safeSave(
+                fcitx::StandardPathsType::PkgData, path,
+                [&content](int fd) { return writeAll(fd, content); })) {
+            FCITX_ERROR() << "Failed to save cloud pinyin cache " << path;
+        }
+    };
+}
+
+std::function<void()>
+PersistentCache::removeTask(std::filesystem::path path) {
+    return [path = std::move(path)]() {
+        std::error_code ec;
+        std::filesystem::remove(fullPath(path), ec);
+    };
+}
+
+std::function<void()>
+PersistentCache::removeAllTask(std::filesystem::path directory) {
+    return [directory = std::move(directory)]() {
+        std::error_code ec;
+        std::vector<std::filesystem::path> files;
+        std::filesystem::directory_iterator iter(fullPath(directory), ec);
+        for (; !ec && iter != std::filesystem::directory_iterator();
+             iter.increment(ec)) {
+            if (iter->path().extension() == ".cache") {
+                files.push_back(iter->path());
+            }
+        }
+        for (const auto &file : files) {
+            std::filesystem::remove(file, ec);
+        }
+    };
+}
@@ -0,0 +1,85 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _CLOUDPINYIN_PERSISTENTCACHE_H_
+#define _CLOUDPINYIN_PERSISTENTCACHE_H_
+
+#include "../../common/lrucache.h"
+#include <cstddef>
+#include <cstdint>
+#include <fcitx-utils/trackableobject.h>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Cloud pinyin results of one backend kept on disk.
+ *
+ * The file is an append-only log with one "time<TAB>pinyin<TAB>candidates"
+ * line per result, candidates are also separated by tab, later lines win.
+ * The file is read by the task from loadTask(), and lookups miss until its
+ * content is passed to setLoaded(). New results are buffered in memory, and
+ * written by the task from flushTask(). Both tasks are expected to run on a
+ * background thread. Once the log grows to twice the entries it holds, the
+ * task rewrites the whole file instead.
+ */
+class PersistentCache : public fcitx::TrackableObject<PersistentCache> {
+public:
+    struct Entry {
+        std::vector<std::string> candidates;
+        int64_t time;
+    };
+
+    // Entries read from the file, the oldest one first.
+    struct Content {
+        std::vector<std::pair<std::string, Entry>> entries;
+        // Lines in the file.
+        size_t lines = 0;
+    };
+
+    // Path is relative to the user PkgData directory, ttl is in seconds.
+    PersistentCache(std::filesystem::path path, size_t size, int64_t ttl);
+
+    bool loaded() const { return loaded_; }
+    // Return a task that reads the file and calls callback with the content
+    // on the same thread. It needs to run before the flush tasks.
+    std::function<void()>
+    loadTask(int64_t now, std::function<void(Content)> callback) const;
+    // Results inserted before it are kept as the newer ones.
+    void setLoaded(Content content);
+
+    const std::vector<std::string> *find(const std::string &pinyin,
+                                         int64_t now);
+    void insert(const std::string &pinyin,
+                const std::vector<std::string> &candidates, int64_t now);
+
+    bool dirty() const { return !pending_.empty() || compact_; }
+    // Return a task that can be run on any thread, tasks of the same file
+    // need to run in order.
+    std::function<void()> flushTask();
+    // Return a task that removes the file at path.
+    static std::function<void()> removeTask(std::filesystem::path path);
+    // Return a task that removes all the cache files in directory.
+    static std::function<void()>
+    removeAllTask(std::filesystem::path directory);
+
+private:
+    void append(const std::string &pinyin, const Entry &entry);
+
+    std::filesystem::path path_;
+    int64_t ttl_;
+    bool loaded_ = false;
+    LRUCache<std::string, Entry> entries_;
+    // Lines that are not written yet.
+    std::string pending_;
+    // Lines in the file, including the pending ones.
+    size_t logSize_ = 0;
+    bool compact_ = false;
+};
+
+#endif // _CLOUDPINYIN_PERSISTENTCACHE_H_
@@ -0,0 +1,70 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _PINYINHELPER_PACKEDSTROKES_H_
+#define _PINYINHELPER_PACKEDSTROKES_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace fcitx {
+
+/*
+ * A stroke sequence packed into an integer. The lowest 6 bits hold the length,
+ * followed by 3 bits for each stroke, 1 to 5. Only the first
+ * PackedStrokeMaxLength strokes are stored, which is enough to tell almost all
+ * chars apart.
+ */
+inline constexpr size_t PackedStrokeMaxLength = 19;
+/* Longest stroke sequence whose length fits in the packed form */
+inline constexpr size_t PackedStrokeMaxInputLength = 0x3f;
+
+/*
+ * Return 0 if strokes is not a valid stroke sequence, or is longer than
+ * PackedStrokeMaxInputLength. Note 0 is also the packed empty sequence, so
+ * callers need to reject such input themselves.
+ */
+constexpr uint64_t packStrokes(std::string_view strokes) {
+    if (strokes.size() > PackedStrokeMaxInputLength) {
+        return 0;
+    }
+    uint64_t result = strokes.size();
+    for (size_t i = 0; i < strokes.size(); i++) {
+        if (strokes[i] < '1' || strokes[i] > '5') {
+            return 0;
+        }
+        if (i < PackedStrokeMaxLength) {
+            result |= static_cast<uint64_t>(strokes[i] - '0') << (6 + 3 * i);
+        }
+    }
+    return result;
+}
+
+/*
+ * Whether packed starts with prefix, everything starts with empty prefix.
+ * Only the first PackedStrokeMaxLength strokes are compared, so if prefix is
+ * longer than that, a match needs to be checked again with the full stroke
+ * strings.
+ */
+constexpr bool packedStrokesStartsWith(uint64_t packed, uint64_t prefix) {
+    const uint64_t prefixLength = prefix & 0x3f;
+    if (!prefixLength) {
+        return true;
+    }
+    if ((packed & 0x3f) < prefixLength) {
+        return false;
+    }
+    const uint64_t compared =
+        std::min<uint64_t>(prefixLength, PackedStrokeMaxLength);
+    const uint64_t mask = ((uint64_t(1) << (3 * compared)) - 1) << 6;
+    return ((packed ^ prefix) & mask) == 0;
+}
+
+} // namespace fcitx
+
+#endif // _PINYINHELPER_PACKEDSTROKES_H_
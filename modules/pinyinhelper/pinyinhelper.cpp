@@ -8,6 +8,8 @@
 #include "pinyinhelper.h"
 #include <algorithm>
 #include <clipboard_public.h>
+#include <cstddef>
+#include <cstdint>
 #include <fcitx-config/iniparser.h>
 #include <fcitx-utils/event.h>
 #include <fcitx-utils/i18n.h>
@@ -105,6 +107,13 @@ PinyinHelper::fullLookup(uint32_t chr) {
     return {};
 }
 
+void PinyinHelper::forEachPinyin(uint32_t chr,
+                                 const PinyinViewCallback &callback) {
+    if (lookup_.load()) {
+        lookup_.forEachPinyin(chr, callback);
+    }
+}
+
 void PinyinHelper::loadStroke() { stroke_.loadAsync(); }
 
 std::vector<std::pair<std::string, std::string>>
@@ -146,6 +155,18 @@ std::string PinyinHelper::reverseLookupStroke(const std::string &input) {
     return stroke_.reverseLookup(input);
 }
 
+std::vector<uint64_t>
+PinyinHelper::lookupPackedStrokes(const std::vector<uint32_t> &chars) {
+    std::vector<uint64_t> result(chars.size(), 0);
+    if (!stroke_.load()) {
+        return result;
+    }
+    for (size_t i = 0; i < chars.size(); i++) {
+        result[i] = stroke_.packedStrokes(chars[i]);
+    }
+    return result;
+}
+
 std::string PinyinHelper::prettyStrokeString(const std::string &input) {
     if (!stroke_.load()) {
         return {};
@@ -16,6 +16,7 @@
 #include <fcitx/addonmanager.h>
 #include <fcitx/instance.h>
 #include <libime/core/datrie.h>
+#include <memory>
 #include <quickphrase_public.h>
 
 namespace fcitx {
@@ -26,17 +27,22 @@ public:
 
     std::vector<std::string> lookup(uint32_t);
     std::vector<std::tuple<std::string, std::string, int>> fullLookup(uint32_t);
+    void forEachPinyin(uint32_t chr, const PinyinViewCallback &callback);
     std::vector<std::pair<std::string, std::string>>
     lookupStroke(const std::string &input, int limit);
     std::string reverseLookupStroke(const std::string &input);
+    std::vector<uint64_t>
+    lookupPackedStrokes(const std::vector<uint32_t> &chars);
     std::string prettyStrokeString(const std::string &input);
     void loadStroke();
 
     FCITX_ADDON_EXPORT_FUNCTION(PinyinHelper, lookup);
     FCITX_ADDON_EXPORT_FUNCTION(PinyinHelper, fullLookup);
+    FCITX_ADDON_EXPORT_FUNCTION(PinyinHelper, forEachPinyin);
     FCITX_ADDON_EXPORT_FUNCTION(PinyinHelper, lookupStroke);
     FCITX_ADDON_EXPORT_FUNCTION(PinyinHelper, loadStroke);
     FCITX_ADDON_EXPORT_FUNCTION(PinyinHelper, reverseLookupStroke);
+    FCITX_ADDON_EXPORT_FUNCTION(PinyinHelper, lookupPackedStrokes);
     FCITX_ADDON_EXPORT_FUNCTION(PinyinHelper, prettyStrokeString);
 
     FCITX_ADDON_DEPENDENCY_LOADER(quickphrase, instance_->addonManager());
@@ -7,21 +7,37 @@
 #ifndef _PINYINHELPER_PINYINHELPER_PUBLIC_H_
 #define _PINYINHELPER_PINYINHELPER_PUBLIC_H_
 
+#include "packedstrokes.h"
+#include <cstdint>
 #include <fcitx/addoninstance.h>
+#include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 
+/* Pinyin with tone, pinyin without tone, and tone */
+using PinyinViewCallback =
+    std::function<void(std::string_view, std::string_view, int)>;
+
 FCITX_ADDON_DECLARE_FUNCTION(PinyinHelper, lookup,
                              std::vector<std::string>(uint32_t));
 /* return with fullpinyin (in form of ü), pinyin with tone, and tone */
 FCITX_ADDON_DECLARE_FUNCTION(
     PinyinHelper, fullLookup,
     std::vector<std::tuple<std::string, std::string, int>>(uint32_t));
+/* Same as fullLookup, strings are valid as long as pinyinhelper is loaded */
+FCITX_ADDON_DECLARE_FUNCTION(PinyinHelper, forEachPinyin,
+                             void(uint32_t, const PinyinViewCallback &));
 FCITX_ADDON_DECLARE_FUNCTION(PinyinHelper, lookupStroke,
                              std::vector<std::pair<std::string, std::string>>(
                                  const std::string &, int limit));
 FCITX_ADDON_DECLARE_FUNCTION(PinyinHelper, reverseLookupStroke,
                              std::string(const std::string &));
+/* Packed stroke sequence of each code point, see fcitx::packStrokes, 0 if it
+ * is unknown */
+FCITX_ADDON_DECLARE_FUNCTION(PinyinHelper, lookupPackedStrokes,
+                             std::vector<uint64_t>(
+                                 const std::vector<uint32_t> &));
 FCITX_ADDON_DECLARE_FUNCTION(PinyinHelper, prettyStrokeString,
                              std::string(const std::string &));
 FCITX_ADDON_DECLARE_FUNCTION(PinyinHelper, loadStroke, void());
@@ -7,19 +7,22 @@
  */
 #include "pinyinlookup.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <fcitx-utils/cutf8.h>
-#include <fcitx-utils/fs.h>
 #include <fcitx-utils/log.h>
 #include <fcitx-utils/macros.h>
 #include <fcitx-utils/standardpaths.h>
-#include <fcitx-utils/stringutils.h>
 #include <fcitx-utils/utf8.h>
 #include <fcntl.h>
+#include <span>
 #include <string>
 #include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <tuple>
-#include <unistd.h>
+#include <utility>
 #include <vector>
 
 namespace fcitx {
@@ -89,42 +92,74 @@ std::string_view py_enhance_get_konsonant(int index) {
     }
     return konsonants_table[index];
 }
+
+constexpr int KonsonantCount = 25;
+constexpr int VokalCount = 41;
+constexpr int ToneCount = 5;
+
+size_t syllableIndex(int consonant, int vocal, int tone) {
+    return ((consonant * VokalCount) + vocal) * ToneCount + tone;
+}
+
+// Unmap the file once parsing is done.
+struct MappedFile {
+    MappedFile(int fd, size_t size)
+        : data(size ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)
+                    : MAP_FAILED),
+          size(size) {}
+    ~MappedFile() {
+        if (data != MAP_FAILED) {
+            ::munmap(data, size);
+        }
+    }
+    void *data;
+    size_t size;
+};
 } // namespace
 
-std::vector<std::string> PinyinLookup::lookup(uint32_t hz) {
-    auto iter = data_.find(hz);
-    if (iter == data_.end()) {
+std::span<const PinyinLookupData> PinyinLookup::readings(uint32_t hz) const {
+    auto iter = std::lower_bound(chars_.begin(), chars_.end(), hz);
+    if (iter == chars_.end() || *iter != hz) {
         return {};
     }
+    auto index = iter - chars_.begin();
+    return std::span<const PinyinLookupData>(readings_)
+        .subspan(offsets_[index], offsets_[index + 1] - offsets_[index]);
+}
+
+std::string_view PinyinLookup::syllable(const PinyinLookupData &data,
+                                        int tone) const {
+    if (tone < 0 || tone >= ToneCount) {
+        tone = 0;
+    }
+    auto index = syllableIndex(data.consonant, data.vocal, tone);
+    return std::string_view(syllables_)
+        .substr(syllableOffsets_[index],
+                syllableOffsets_[index + 1] - syllableOffsets_[index]);
+}
+
+void PinyinLookup::forEachPinyin(uint32_t hz,
+                                 const PinyinViewCallback &callback) const {
+    for (const auto &data : readings(hz)) {
+        callback(syllable(data, data.tone), syllable(data, 0), data.tone);
+    }
+}
+
+std::vector<std::string> PinyinLookup::lookup(uint32_t hz) {
     std::vector<std::string> result;
-    for (const auto &data : iter->second) {
-        auto c = py_enhance_get_konsonant(data.consonant);
-        auto v = py_enhance_get_vokal(data.vocal, data.tone);
-        if (c.empty() && v.empty()) {
-            continue;
-        }
-        result.emplace_back(stringutils::concat(c, v));
+    for (const auto &data : readings(hz)) {
+        result.emplace_back(syllable(data, data.tone));
     }
     return result;
 }
 
 std::vector<std::tuple<std::string, std::string, int>>
 PinyinLookup::fullLookup(uint32_t hz) {
-    auto iter = data_.find(hz);
-    if (iter == data_.end()) {
-        return {};
-    }
     std::vector<std::tuple<std::string, std::string, int>> result;
-    for (const auto &data : iter->second) {
-        auto c = py_enhance_get_konsonant(data.consonant);
-        auto v = py_enhance_get_vokal(data.vocal, data.tone);
-        if (c.empty() && v.empty()) {
-            continue;
-        }
-        auto noToneV = py_enhance_get_vokal(data.vocal, 0);
-        result.emplace_back(stringutils::concat(c, v),
-                            stringutils::concat(c, noToneV), data.tone);
-    }
+    forEachPinyin(hz, [&result](std::string_view pinyin,
+                                std::string_view noTonePinyin, int tone) {
+        result.emplace_back(pinyin, noTonePinyin, tone);
+    });
     return result;
 }
 
@@ -134,11 +169,38 @@ bool PinyinLookup::load() {
     }
     loaded_ = true;
 
+    syllableOffsets_.reserve(KonsonantCount * VokalCount * ToneCount + 1);
+    for (int c = 0; c < KonsonantCount; c++) {
+        for (int v = 0; v < VokalCount; v++) {
+            for (int t = 0; t < ToneCount; t++) {
+                syllableOffsets_.push_back(syllables_.size());
+                syllables_.append(py_enhance_get_konsonant(c));
+                syllables_.append(py_enhance_get_vokal(v, t));
+            }
+        }
+    }
+    syllableOffsets_.push_back(syllables_.size());
+
     auto file = StandardPaths::global().open(StandardPathsType::PkgData,
                                              "pinyinhelper/py_table.mb");
     if (!file.isValid()) {
         return false;
     }
+    struct stat st;
+    if (fstat(file.fd(), &st) != 0) {
+        return false;
+    }
+    MappedFile mapped(file.fd(), st.st_size);
+    if (mapped.data == MAP_FAILED) {
+        return false;
+    }
+    loadResult_ =
+        parse(std::string_view(static_cast<const char *>(mapped.data),
+                               mapped.size));
+    return loadResult_;
+}
+
+bool PinyinLookup::parse(std::string_view content) {
     /**
      * Format:
      * uint8_t word_l;
@@ -146,42 +208,53 @@ bool PinyinLookup::load() {
      * uint8_t count;
      * int8_t py[count][3];
      **/
-    while (true) {
-        char word[FCITX_UTF8_MAX_LENGTH + 1];
-        uint8_t wordLen;
-        auto res = fs::safeRead(file.fd(), &wordLen, 1);
-        if (res == 0) {
-            break;
-        }
-        if (res < 0 || wordLen > FCITX_UTF8_MAX_LENGTH) {
+    std::vector<std::pair<uint32_t, PinyinLookupData>> entries;
+    while (!content.empty()) {
+        uint8_t wordLen = content[0];
+        if (wordLen > FCITX_UTF8_MAX_LENGTH || content.size() < wordLen + 2U) {
             return false;
         }
-        if (read(file.fd(), word, wordLen) != wordLen) {
+        auto word = content.substr(1, wordLen);
+        if (utf8::lengthValidated(word) != 1) {
             return false;
         }
-        word[wordLen] = '\0';
-        std::string_view view(word);
-        if (utf8::lengthValidated(view) != 1) {
+        uint32_t chr = utf8::getChar(word);
+        uint8_t count = content[wordLen + 1];
+        content.remove_prefix(wordLen + 2);
+        if (content.size() < count * 3U) {
             return false;
         }
-        uint32_t chr = utf8::getChar(view);
-        uint8_t count;
-        if (read(file.fd(), &count, 1) != 1) {
-            return false;
-        }
-        if (count == 0) {
-            continue;
-        }
-        auto &data = data_[chr];
-        while (count--) {
-            uint8_t buf[3];
-            if (read(file.fd(), buf, 3) != 3) {
-                return false;
+        for (uint8_t i = 0; i < count; i++) {
+            PinyinLookupData data{static_cast<uint8_t>(content[i * 3]),
+                                  static_cast<uint8_t>(content[i * 3 + 1]),
+                                  static_cast<uint8_t>(content[i * 3 + 2])};
+            // Unknown part is the same as empty one.
+            if (data.consonant >= KonsonantCount) {
+                data.consonant = 0;
             }
-            data.push_back({buf[0], buf[1], buf[2]});
+            if (data.vocal >= VokalCount) {
+                data.vocal = 0;
+            }
+            if (data.consonant || data.vocal) {
+                entries.emplace_back(chr, data);
+            }
+        }
+        content.remove_prefix(count * 3);
+    }
+
+    // Keep the readings of the same char in the file order.
+    std::stable_sort(
+        entries.begin(), entries.end(),
+        [](const auto &lhs, const auto &rhs) { return lhs.first < rhs.first; });
+    readings_.reserve(entries.size());
+    for (const auto &[chr, data] : entries) {
+        if (chars_.empty() || chars_.back() != chr) {
+            chars_.push_back(chr);
+            offsets_.push_back(readings_.size());
         }
+        readings_.push_back(data);
     }
-    loadResult_ = true;
+    offsets_.push_back(readings_.size());
     return true;
 }
 } // namespace fcitx
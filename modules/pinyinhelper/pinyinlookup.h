@@ -7,10 +7,12 @@
 #ifndef _PINYINHELPER_PINYINLOOKUP_H_
 #define _PINYINHELPER_PINYINLOOKUP_H_
 
+#include "pinyinhelper_public.h"
 #include <cstdint>
+#include <span>
 #include <string>
+#include <string_view>
 #include <tuple>
-#include <unordered_map>
 #include <vector>
 
 namespace fcitx {
@@ -27,9 +29,23 @@ public:
     std::vector<std::string> lookup(uint32_t hz);
     std::vector<std::tuple<std::string, std::string, int>>
     fullLookup(uint32_t hz);
+    // Same as fullLookup, but the strings point into the precomputed
+    // syllables and stay valid as long as this object.
+    void forEachPinyin(uint32_t hz, const PinyinViewCallback &callback) const;
 
 private:
-    std::unordered_map<uint32_t, std::vector<PinyinLookupData>> data_;
+    bool parse(std::string_view content);
+    std::span<const PinyinLookupData> readings(uint32_t hz) const;
+    std::string_view syllable(const PinyinLookupData &data, int tone) const;
+
+    // Sorted code points, chars_[i] has
+    // readings_[offsets_[i], offsets_[i + 1]).
+    std::vector<uint32_t> chars_;
+    std::vector<uint32_t> offsets_;
+    std::vector<PinyinLookupData> readings_;
+    // Every consonant, vocal and tone combination.
+    std::string syllables_;
+    std::vector<uint32_t> syllableOffsets_;
     bool loaded_ = false;
     bool loadResult_ = false;
 };
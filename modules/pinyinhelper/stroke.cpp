@@ -6,26 +6,24 @@
  *
  */
 #include "stroke.h"
+#include "strokedata.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <exception>
 #include <fcitx-utils/fdstreambuf.h>
-#include <fcitx-utils/macros.h>
+#include <fcitx-utils/log.h>
 #include <fcitx-utils/standardpaths.h>
-#include <fcitx-utils/stringutils.h>
-#include <fcitx-utils/utf8.h>
 #include <fcntl.h>
-#include <functional>
 #include <future>
 #include <istream>
 #include <libime/core/datrie.h>
+#include <limits>
 #include <optional>
-#include <queue>
 #include <stdexcept>
 #include <string>
 #include <string_view>
-#include <tuple>
-#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -39,53 +37,29 @@ void Stroke::loadAsync() {
     }
 
     loadFuture_ = std::async(std::launch::async, []() {
-        std::tuple<libime::DATrie<int32_t>, libime::DATrie<int32_t>> result;
-        auto &dict = std::get<0>(result);
-        auto &reverseDict = std::get<1>(result);
-
+        // Prefer the compiled data, which is much faster to load.
         auto file = StandardPaths::global().open(StandardPathsType::PkgData,
-                                                 "pinyinhelper/py_stroke.mb");
+                                                 "pinyinhelper/py_stroke.dict");
+        if (file.isValid()) {
+            try {
+                IFDStreamBuf buffer(file.fd());
+                std::istream in(&buffer);
+                return loadStrokeData(in);
+            } catch (const std::exception &e) {
+                FCITX_WARN() << "Failed to load compiled stroke data: "
+                             << e.what();
+            }
+        }
+
+        file = StandardPaths::global().open(StandardPathsType::PkgData,
+                                            "pinyinhelper/py_stroke.mb");
         if (!file.isValid()) {
             throw std::runtime_error("Failed to open file");
         }
 
         IFDStreamBuf buffer(file.fd());
         std::istream in(&buffer);
-        std::string buf;
-        while (!in.eof()) {
-            if (!std::getline(in, buf)) {
-                break;
-            }
-            // Validate everything first, so it's easier to process.
-            if (!utf8::validate(buf)) {
-                continue;
-            }
-
-            auto line = stringutils::trimView(buf);
-            if (line.empty() || line[0] == '#') {
-                continue;
-            }
-            auto pos = line.find_first_of(FCITX_WHITESPACE);
-            if (pos == std::string::npos) {
-                continue;
-            }
-            std::string_view key = line.substr(0, pos);
-            std::string_view value =
-                stringutils::trimView(line.substr(pos + 1));
-            if (utf8::length(value) != 1 ||
-                key.find_first_not_of("12345") != std::string::npos) {
-                continue;
-            }
-            std::string token = stringutils::concat(key, "|", value);
-            std::string reverseToken = stringutils::concat(value, "|", key);
-            dict.set(token, 1);
-            reverseDict.set(reverseToken, 1);
-        }
-
-        dict.shrink_tail();
-        reverseDict.shrink_tail();
-
-        return result;
+        return parseStrokeText(in);
     });
 }
 
@@ -97,7 +71,11 @@ bool Stroke::load() {
         loadAsync();
     }
     try {
-        std::tie(dict_, revserseDict_) = loadFuture_.get();
+        auto data = loadFuture_.get();
+        dict_ = std::move(data.dict);
+        revserseDict_ = std::move(data.reverseDict);
+        packedChars_ = std::move(data.packedChars);
+        packedStrokes_ = std::move(data.packedStrokes);
         loadResult_ = true;
     } catch (...) {
         loadResult_ = false;
@@ -107,39 +85,144 @@ bool Stroke::load() {
     return true;
 }
 
-#define DELETION_WEIGHT 5
-#define INSERTION_WEIGHT 5
-#define SUBSTITUTION_WEIGHT 5
-#define TRANSPOSITION_WEIGHT 5
+namespace {
+
+using StrokeResult = std::vector<std::pair<std::string, std::string>>;
+
+// Key is "strokes|hanzi", only the first one of each hanzi is kept.
+void addResult(StrokeResult &result, std::string_view key,
+               size_t strokeLength) {
+    auto hanzi = key.substr(strokeLength + 1);
+    if (std::any_of(result.begin(), result.end(), [hanzi](const auto &item) {
+            return item.first == hanzi;
+        })) {
+        return;
+    }
+    result.emplace_back(hanzi, key.substr(0, strokeLength));
+}
+
+/*
+ * Walk the trie with a Levenshtein automaton, which finds all words whose
+ * strokes are within one deletion, insertion, substitution or transposition
+ * of the input. Words are found in stroke order, exact matches come first.
+ */
+class FuzzySearch {
+public:
+    using position_type = libime::DATrie<int32_t>::position_type;
+    // Larger distance is never interesting, so it's capped.
+    static constexpr int MaxDistance = 2;
+
+    FuzzySearch(const libime::DATrie<int32_t> &dict, std::string_view input,
+                size_t limit, StrokeResult &result)
+        : dict_(dict), input_(input), limit_(limit), result_(result),
+          width_(input.size() + 1), rows_((input.size() + 2) * width_),
+          path_(input.size() + 1, '\0') {
+        for (size_t j = 0; j < width_; j++) {
+            rows_[j] = std::min<int>(j, MaxDistance);
+        }
+    }
+
+    void run() {
+        position_type pos = 0;
+        if (!libime::DATrie<int32_t>::isNoPath(dict_.traverse(input_, pos)) &&
+            !addWords(input_.size(), pos)) {
+            return;
+        }
+        search(0, 0);
+    }
+
+private:
+    // Return false if limit is reached.
+    bool addWords(size_t depth, position_type pos) {
+        std::string buf;
+        return dict_.foreach(
+            "|",
+            [this, &buf, depth](int32_t, size_t len, uint64_t wordPos) {
+                dict_.suffix(buf, depth + 1 + len, wordPos);
+                addResult(result_, buf, depth);
+                return result_.size() < limit_;
+            },
+            pos);
+    }
+
+    // rows_ holds the distance between the first depth strokes of path_ and
+    // every prefix of the input.
+    bool search(size_t depth, position_type pos) {
+        const auto *prev = &rows_[depth * width_];
+        if (prev[input_.size()] == 1 && !addWords(depth, pos)) {
+            return false;
+        }
+        // Any longer path is at least two insertions away.
+        if (depth > input_.size()) {
+            return true;
+        }
+        for (char c = '1'; c <= '5'; c++) {
+            auto next = pos;
+            if (libime::DATrie<int32_t>::isNoPath(
+                    dict_.traverse(&c, 1, next))) {
+                continue;
+            }
+            path_[depth] = c;
+            auto *row = &rows_[(depth + 1) * width_];
+            row[0] = std::min<int>(depth + 1, MaxDistance);
+            int best = row[0];
+            for (size_t j = 1; j < width_; j++) {
+                int distance =
+                    std::min({prev[j] + 1, row[j - 1] + 1,
+                              prev[j - 1] + (input_[j - 1] == c ? 0 : 1)});
+                if (depth >= 1 && j >= 2 && input_[j - 2] == c &&
+                    input_[j - 1] == path_[depth - 1]) {
+                    distance = std::min(
+                        distance, rows_[(depth - 1) * width_ + j - 2] + 1);
+                }
+                row[j] = std::min(distance, MaxDistance);
+                best = std::min<int>(best, row[j]);
+            }
+            if (best < MaxDistance && !search(depth + 1, next)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const libime::DATrie<int32_t> &dict_;
+    std::string_view input_;
+    size_t limit_;
+    StrokeResult &result_;
+    size_t width_;
+    std::vector<int> rows_;
+    std::string path_;
+};
+
+} // namespace
 
 std::vector<std::pair<std::string, std::string>>
 Stroke::lookup(std::string_view input, int limit) {
-    std::vector<std::pair<std::string, std::string>> result;
-    std::unordered_set<std::string> resultSet;
-    using position_type = decltype(dict_)::position_type;
-    struct LookupItem {
-        position_type pos;
-        std::string_view remain;
-        int weight;
-        int length;
+    const size_t maxResult =
+        limit > 0 ? limit : std::numeric_limits<size_t>::max();
+    std::string key(input);
+    // A result is reusable if it asked for enough, or it already has all.
+    if (auto *cached = cache_.find(key);
+        cached && (cached->limit >= maxResult ||
+                   cached->result.size() < cached->limit)) {
+        return {cached->result.begin(),
+                cached->result.begin() +
+                    std::min(maxResult, cached->result.size())};
+    }
+    auto result = search(input, maxResult);
+    cache_.erase(key);
+    cache_.insert(key, CachedResult{.limit = maxResult, .result = result});
+    return result;
+}
 
-        bool operator>(const LookupItem &other) const {
-            return weight > other.weight;
-        }
-    };
-    std::priority_queue<LookupItem, std::vector<LookupItem>,
-                        std::greater<LookupItem>>
-        q;
+std::vector<std::pair<std::string, std::string>>
+Stroke::search(std::string_view input, size_t limit) const {
+    StrokeResult result;
+    using position_type = decltype(dict_)::position_type;
 
     // First lets check if the stroke is already a prefix of single word.
     std::optional<position_type> onlyMatch;
     size_t onlyMatchLength = 0;
-    auto addResult = [&result, &resultSet](std::string stroke, std::string hz) {
-        if (resultSet.insert(hz).second) {
-            result.emplace_back(std::move(stroke), std::move(hz));
-        }
-    };
-
     if (dict_.foreach(input, [&onlyMatch, &onlyMatchLength](int32_t, size_t len,
                                                             uint64_t pos) {
             if (onlyMatch) {
@@ -153,89 +236,15 @@ Stroke::lookup(std::string_view input, int limit) {
             std::string buf;
             dict_.suffix(buf, input.size() + onlyMatchLength, *onlyMatch);
             if (auto idx = buf.find_last_of('|'); idx != std::string::npos) {
-                addResult(buf.substr(idx + 1), buf.substr(0, idx));
+                addResult(result, buf, idx);
             }
         }
     }
-    if (result.size() >= static_cast<size_t>(limit)) {
+    if (result.size() >= limit) {
         return result;
     }
 
-    auto pushQueue = [&q](LookupItem &&item) {
-        if (item.weight >= 10) {
-            return;
-        }
-        q.push(item);
-    };
-
-    pushQueue(LookupItem{.pos = 0, .remain = input, .weight = 0, .length = 0});
-
-    while (!q.empty()) {
-        auto current = q.top();
-        q.pop();
-        if (current.remain.empty()) {
-            if (!dict_.foreach(
-                    "|",
-                    [this, &result, &current, limit,
-                     &addResult](int32_t, size_t len, uint64_t pos) {
-                        std::string buf;
-                        dict_.suffix(buf, current.length + 1 + len, pos);
-                        addResult(buf.substr(current.length + 1),
-                                  buf.substr(0, current.length));
-                        return limit <= 0 ||
-                               result.size() < static_cast<size_t>(limit);
-                    },
-                    current.pos)) {
-                break;
-            }
-        }
-
-        // Deletion
-        if (!current.remain.empty()) {
-            pushQueue(LookupItem{.pos = current.pos,
-                                 .remain = current.remain.substr(1),
-                                 .weight = current.weight + DELETION_WEIGHT,
-                                 .length = current.length});
-        }
-
-        for (char i = '1'; i <= '5'; i++) {
-            auto pos = current.pos;
-            auto v = dict_.traverse(&i, 1, pos);
-            if (libime::DATrie<int32_t>::isNoPath(v)) {
-                continue;
-            }
-            if (!current.remain.empty() && current.remain[0] == i) {
-                pushQueue(LookupItem{.pos = pos,
-                                     .remain = current.remain.substr(1),
-                                     .weight = current.weight,
-                                     .length = current.length + 1});
-            } else {
-                pushQueue(
-                    LookupItem{.pos = pos,
-                               .remain = current.remain,
-                               .weight = current.weight + INSERTION_WEIGHT,
-                               .length = current.length + 1});
-                if (!current.remain.empty()) {
-                    pushQueue(LookupItem{.pos = pos,
-                                         .remain = current.remain.substr(1),
-                                         .weight = current.weight +
-                                                   SUBSTITUTION_WEIGHT,
-                                         .length = current.length + 1});
-                }
-            }
-
-            if (current.remain.size() >= 2 && current.remain[1] == i) {
-                auto nextPos = pos;
-                auto nextV = dict_.traverse(current.remain.data(), 1, nextPos);
-                if (!libime::DATrie<int32_t>::isNoPath(nextV)) {
-                    pushQueue(LookupItem{nextPos, current.remain.substr(2),
-                                         current.weight + TRANSPOSITION_WEIGHT,
-                                         current.length + 2});
-                }
-            }
-        }
-    }
-
+    FuzzySearch(dict_, input, limit, result).run();
     return result;
 }
 
@@ -271,6 +280,14 @@ std::string Stroke::reverseLookup(const std::string &hanzi) const {
     return {};
 }
 
+uint64_t Stroke::packedStrokes(uint32_t chr) const {
+    auto iter = std::lower_bound(packedChars_.begin(), packedChars_.end(), chr);
+    if (iter == packedChars_.end() || *iter != chr) {
+        return 0;
+    }
+    return packedStrokes_[iter - packedChars_.begin()];
+}
+
 std::string Stroke::prettyString(const std::string &input) const {
     std::string result;
     static const std::string_view stroke_table[] = {"一", "丨", "丿",
@@ -7,12 +7,16 @@
 #ifndef _PINYINHELPER_STROKE_H_
 #define _PINYINHELPER_STROKE_H_
 
+#include "../../common/lrucache.h"
+#include "strokedata.h"
+#include <cstddef>
 #include <cstdint>
 #include <future>
 #include <libime/core/datrie.h>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <utility>
+#include <vector>
 
 namespace fcitx {
 
@@ -22,19 +26,33 @@ public:
 
     void loadAsync();
     bool load();
+    // Return pairs of hanzi and strokes within one edit of input, limit <= 0
+    // means no limit. Recent queries are cached.
     std::vector<std::pair<std::string, std::string>>
     lookup(std::string_view input, int limit);
     std::string prettyString(const std::string &input) const;
     std::string reverseLookup(const std::string &hanzi) const;
+    // Same stroke sequence as reverseLookup, but packed by packStrokes.
+    uint64_t packedStrokes(uint32_t chr) const;
 
 private:
+    std::vector<std::pair<std::string, std::string>>
+    search(std::string_view input, size_t limit) const;
+
+    struct CachedResult {
+        size_t limit;
+        std::vector<std::pair<std::string, std::string>> result;
+    };
+
     libime::DATrie<int32_t> dict_;
     libime::DATrie<int32_t> revserseDict_;
+    std::vector<uint32_t> packedChars_;
+    std::vector<uint64_t> packedStrokes_;
     bool loaded_ = false;
     bool loadResult_ = false;
+    LRUCache<std::string, CachedResult> cache_{64};
 
-    std::future<std::tuple<libime::DATrie<int32_t>, libime::DATrie<int32_t>>>
-        loadFuture_;
+    std::future<StrokeData> loadFuture_;
 };
 } // namespace fcitx
 
@@ -0,0 +1,154 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "strokedata.h"
+#include "packedstrokes.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fcitx-utils/macros.h>
+#include <fcitx-utils/stringutils.h>
+#include <fcitx-utils/utf8.h>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace fcitx {
+
+namespace {
+
+constexpr char StrokeDataMagic[] = {'F', 'S', 'T', 'K'};
+constexpr uint32_t StrokeDataVersion = 1;
+
+template <typename T>
+void writeLittleEndian(std::ostream &out, T value) {
+    char buf[sizeof(T)];
+    for (size_t i = 0; i < sizeof(T); i++) {
+        buf[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+    out.write(buf, sizeof(T));
+}
+
+template <typename T>
+T readLittleEndian(std::istream &in) {
+    unsigned char buf[sizeof(T)];
+    if (!in.read(reinterpret_cast<char *>(buf), sizeof(T))) {
+        throw std::runtime_error("Unexpected end of stroke data");
+    }
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        value |= static_cast<T>(buf[i]) << (8 * i);
+    }
+    return value;
+}
+
+} // namespace
+
+StrokeData parseStrokeText(std::istream &in) {
+    StrokeData result;
+    // Smallest stroke sequence of each char, like Stroke::reverseLookup.
+    std::unordered_map<uint32_t, std::string> firstStrokes;
+
+    std::string buf;
+    while (!in.eof()) {
+        if (!std::getline(in, buf)) {
+            break;
+        }
+        // Validate everything first, so it's easier to process.
+        if (!utf8::validate(buf)) {
+            continue;
+        }
+
+        auto line = stringutils::trimView(buf);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        auto pos = line.find_first_of(FCITX_WHITESPACE);
+        if (pos == std::string::npos) {
+            continue;
+        }
+        std::string_view key = line.substr(0, pos);
+        std::string_view value = stringutils::trimView(line.substr(pos + 1));
+        if (utf8::length(value) != 1 ||
+            key.find_first_not_of("12345") != std::string::npos) {
+            continue;
+        }
+        std::string token = stringutils::concat(key, "|", value);
+        std::string reverseToken = stringutils::concat(value, "|", key);
+        result.dict.set(token, 1);
+        result.reverseDict.set(reverseToken, 1);
+        auto [iter, inserted] =
+            firstStrokes.try_emplace(utf8::getChar(value), key);
+        if (!inserted && key < iter->second) {
+            iter->second = key;
+        }
+    }
+
+    result.dict.shrink_tail();
+    result.reverseDict.shrink_tail();
+
+    result.packedChars.reserve(firstStrokes.size());
+    for (const auto &item : firstStrokes) {
+        result.packedChars.push_back(item.first);
+    }
+    std::sort(result.packedChars.begin(), result.packedChars.end());
+    result.packedStrokes.reserve(result.packedChars.size());
+    for (auto chr : result.packedChars) {
+        result.packedStrokes.push_back(packStrokes(firstStrokes[chr]));
+    }
+    return result;
+}
+
+void saveStrokeData(std::ostream &out, const StrokeData &data) {
+    out.write(StrokeDataMagic, sizeof(StrokeDataMagic));
+    writeLittleEndian<uint32_t>(out, StrokeDataVersion);
+    data.dict.save(out);
+    data.reverseDict.save(out);
+    writeLittleEndian<uint32_t>(out, data.packedChars.size());
+    for (auto chr : data.packedChars) {
+        writeLittleEndian<uint32_t>(out, chr);
+    }
+    for (auto strokes : data.packedStrokes) {
+        writeLittleEndian<uint64_t>(out, strokes);
+    }
+    if (!out) {
+        throw std::runtime_error("Failed to write stroke data");
+    }
+}
+
+StrokeData loadStrokeData(std::istream &in) {
+    char magic[sizeof(StrokeDataMagic)];
+    if (!in.read(magic, sizeof(magic)) ||
+        !std::equal(std::begin(magic), std::end(magic),
+                    std::begin(StrokeDataMagic))) {
+        throw std::runtime_error("Invalid stroke data");
+    }
+    if (readLittleEndian<uint32_t>(in) != StrokeDataVersion) {
+        throw std::runtime_error("Unsupported stroke data version");
+    }
+    StrokeData result;
+    result.dict.load(in);
+    result.reverseDict.load(in);
+    const auto size = readLittleEndian<uint32_t>(in);
+    result.packedChars.reserve(size);
+    for (uint32_t i = 0; i < size; i++) {
+        result.packedChars.push_back(readLittleEndian<uint32_t>(in));
+    }
+    result.packedStrokes.reserve(size);
+    for (uint32_t i = 0; i < size; i++) {
+        result.packedStrokes.push_back(readLittleEndian<uint64_t>(in));
+    }
+    if (!std::is_sorted(result.packedChars.begin(), result.packedChars.end())) {
+        throw std::runtime_error("Invalid stroke data");
+    }
+    return result;
+}
+
+} // namespace fcitx
@@ -0,0 +1,39 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _PINYINHELPER_STROKEDATA_H_
+#define _PINYINHELPER_STROKEDATA_H_
+
+#include <cstdint>
+#include <istream>
+#include <libime/core/datrie.h>
+#include <ostream>
+#include <vector>
+
+namespace fcitx {
+
+struct StrokeData {
+    // "strokes|hanzi"
+    libime::DATrie<int32_t> dict;
+    // "hanzi|strokes"
+    libime::DATrie<int32_t> reverseDict;
+    // Sorted by code point, with the smallest stroke sequence of each char
+    // packed by packStrokes.
+    std::vector<uint32_t> packedChars;
+    std::vector<uint64_t> packedStrokes;
+};
+
+// Parse the text py_stroke.mb, one "strokes hanzi" per line.
+StrokeData parseStrokeText(std::istream &in);
+
+// Compiled form of StrokeData, which avoids parsing the text at startup.
+// Loading throws if the data is not in the expected format.
+void saveStrokeData(std::ostream &out, const StrokeData &data);
+StrokeData loadStrokeData(std::istream &in);
+
+} // namespace fcitx
+
+#endif // _PINYINHELPER_STROKEDATA_H_
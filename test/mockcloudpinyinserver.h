@@ -0,0 +1,325 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _TEST_MOCKCLOUDPINYINSERVER_H_
+#define _TEST_MOCKCLOUDPINYINSERVER_H_
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/unixfd.h>
+#include <fcntl.h>
+#include <mutex>
+#include <netinet/in.h>
+#include <optional>
+#include <poll.h>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * HTTP server on localhost that answers like the cloud pinyin backends.
+ *
+ * Requests to /inputtools/request get a Google style response, and requests
+ * to /py get a Baidu style one. The results of pinyin are "云" + pinyin and
+ * "雲" + pinyin.
+ * Behavior can be changed by the prefix of pinyin:
+ * - "error": answer with HTTP status 500.
+ * - "portal": answer with a HTML page, like a captive portal.
+ * - "close": close the connection without answer.
+ * - "slow": add SlowLatency to the latency.
+ */
+class MockCloudPinyinServer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr auto SlowLatency = std::chrono::milliseconds(300);
+
+    MockCloudPinyinServer() {
+        listen_ = fcitx::UnixFD::own(
+            ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+        FCITX_ASSERT(listen_.isValid());
+        const int reuse = 1;
+        setsockopt(listen_.fd(), SOL_SOCKET, SO_REUSEADDR, &reuse,
+                   sizeof(reuse));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        FCITX_ASSERT(::bind(listen_.fd(), reinterpret_cast<sockaddr *>(&addr),
+                            sizeof(addr)) == 0);
+        FCITX_ASSERT(::listen(listen_.fd(), SOMAXCONN) == 0);
+        socklen_t length = sizeof(addr);
+        FCITX_ASSERT(::getsockname(listen_.fd(),
+                                   reinterpret_cast<sockaddr *>(&addr),
+                                   &length) == 0);
+        port_ = ntohs(addr.sin_port);
+
+        int fds[2];
+        FCITX_ASSERT(::pipe2(fds, O_CLOEXEC | O_NONBLOCK) == 0);
+        wakeupRead_.give(fds[0]);
+        wakeupWrite_.give(fds[1]);
+        thread_ = std::thread(&MockCloudPinyinServer::run, this);
+    }
+
+    ~MockCloudPinyinServer() {
+        const char c = 0;
+        FCITX_ASSERT(::write(wakeupWrite_.fd(), &c, 1) == 1);
+        thread_.join();
+    }
+
+    std::string url() const {
+        return "http://127.0.0.1:" + std::to_string(port_);
+    }
+
+    void setLatency(std::chrono::microseconds latency) {
+        latency_ = latency.count();
+    }
+
+    size_t requests(const std::string &pinyin) const {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        auto iter = requests_.find(pinyin);
+        return iter == requests_.end() ? 0 : iter->second;
+    }
+    size_t totalRequests() const {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        return totalRequests_;
+    }
+    // Most requests that are received but not answered at the same time.
+    size_t maxConcurrent() const {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        return maxConcurrent_;
+    }
+    size_t connections() const {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        return connections_;
+    }
+    void resetStats() {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        requests_.clear();
+        totalRequests_ = 0;
+        maxConcurrent_ = 0;
+        connections_ = 0;
+    }
+
+private:
+    struct Connection {
+        fcitx::UnixFD fd;
+        std::string buffer;
+        // Response waiting for the latency, empty to close the connection.
+        std::optional<std::string> response;
+        Clock::time_point due;
+        bool waiting = false;
+    };
+
+    static std::string decode(std::string_view value) {
+        std::string result;
+        for (size_t i = 0; i < value.size(); i++) {
+            if (value[i] == '%' && i + 2 < value.size()) {
+                result.push_back(static_cast<char>(
+                    std::stoi(std::string(value.substr(i + 1, 2)), nullptr,
+                              16)));
+                i += 2;
+            } else {
+                result.push_back(value[i]);
+            }
+        }
+        return result;
+    }
+
+    static std::string queryValue(std::string_view target,
+                                  std::string_view name) {
+        const auto query = target.find('?');
+        if (query == std::string_view::npos) {
+            return {};
+        }
+        auto params = target.substr(query + 1);
+        while (!params.empty()) {
+            const auto end = std::min(params.find('&'), params.size());
+            const auto param = params.substr(0, end);
+            if (param.starts_with(name) && param.size() > name.size() &&
+                param[name.size()] == '=') {
+                return decode(param.substr(name.size() + 1));
+            }
+            params.remove_prefix(std::min(end + 1, params.size()));
+        }
+        return {};
+    }
+
+    static std::string httpResponse(int code, std::string_view body) {
+        std::string response = "HTTP/1.1 " + std::to_string(code) +
+                               (code == 200 ? " OK" : " Error") +
+                               "\r\nContent-Type: application/json"
+                               "\r\nContent-Length: " +
+                               std::to_string(body.size()) + "\r\n\r\n";
+        response.append(body);
+        return response;
+    }
+
+    // Return the latency and response of a request, nullopt to close the
+    // connection.
+    std::pair<Clock::duration, std::optional<std::string>>
+    handleRequest(std::string_view request) {
+        // GET <target> HTTP/1.1
+        const auto start = request.find(' ') + 1;
+        const auto target =
+            request.substr(start, request.find(' ', start) - start);
+        const bool google = target.starts_with("/inputtools/request");
+        const auto pinyin = queryValue(target, google ? "text" : "input");
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            requests_[pinyin] += 1;
+            totalRequests_ += 1;
+        }
+
+        Clock::duration latency = std::chrono::microseconds(latency_.load());
+        if (pinyin.starts_with("slow")) {
+            latency += SlowLatency;
+        }
+        if (pinyin.starts_with("close")) {
+            return {latency, std::nullopt};
+        }
+        if (pinyin.starts_with("error")) {
+            return {latency, httpResponse(500, "")};
+        }
+        if (pinyin.starts_with("portal")) {
+            return {latency, httpResponse(200, "<html>Login</html>")};
+        }
+        const std::string hanzi = "云" + pinyin;
+        const std::string second = "雲" + pinyin;
+        if (google) {
+            return {latency,
+                    httpResponse(200, "[\"SUCCESS\",[[\"" + pinyin + "\",[\"" +
+                                          hanzi + "\",\"" + second +
+                                          "\"],[],{}]]]")};
+        }
+        const std::string info = ",5,{\"pinyin\":\"" + pinyin + "\"}]";
+        return {latency,
+                httpResponse(200, "{\"0\":[[[\"" + hanzi + "\"" + info +
+                                      ",[\"" + second + "\"" + info +
+                                      "]],\"1\":\"" + pinyin +
+                                      "\",\"status\":\"T\"}")};
+    }
+
+    void run() {
+        std::vector<Connection> connections;
+        size_t concurrent = 0;
+        while (true) {
+            std::vector<pollfd> fds;
+            fds.push_back({wakeupRead_.fd(), POLLIN, 0});
+            fds.push_back({listen_.fd(), POLLIN, 0});
+            auto timeout = -1;
+            const auto now = Clock::now();
+            for (const auto &connection : connections) {
+                fds.push_back({connection.fd.fd(),
+                               static_cast<short>(connection.waiting ? 0
+                                                                     : POLLIN),
+                               0});
+                if (connection.waiting) {
+                    const auto wait =
+                        std::chrono::ceil<std::chrono::milliseconds>(
+                            connection.due - now)
+                            .count();
+                    const auto value = static_cast<int>(std::max<int64_t>(
+                        wait, 0));
+                    timeout = timeout < 0 ? value : std::min(timeout, value);
+                }
+            }
+            if (::poll(fds.data(), fds.size(), timeout) < 0) {
+                continue;
+            }
+            if (fds[0].revents) {
+                break;
+            }
+            if (fds[1].revents & POLLIN) {
+                int fd;
+                while ((fd = ::accept4(listen_.fd(), nullptr, nullptr,
+                                       SOCK_CLOEXEC)) >= 0) {
+                    connections.push_back({});
+                    connections.back().fd.give(fd);
+                    const std::lock_guard<std::mutex> lock(mutex_);
+                    connections_ += 1;
+                }
+            }
+
+            const auto current = Clock::now();
+            std::vector<Connection> alive;
+            for (size_t i = 0; i < connections.size(); i++) {
+                // Accepted ones are not polled yet.
+                const bool readable =
+                    i + 2 < fds.size() && fds[i + 2].revents;
+                if (serve(connections[i], readable, current, concurrent)) {
+                    alive.push_back(std::move(connections[i]));
+                }
+            }
+            connections = std::move(alive);
+        }
+    }
+
+    // Return false if the connection is closed.
+    bool serve(Connection &connection, bool readable, Clock::time_point now,
+               size_t &concurrent) {
+        if (connection.waiting) {
+            if (connection.due > now) {
+                return true;
+            }
+            connection.waiting = false;
+            concurrent -= 1;
+            if (!connection.response ||
+                ::send(connection.fd.fd(), connection.response->data(),
+                       connection.response->size(), MSG_NOSIGNAL) < 0) {
+                return false;
+            }
+        } else if (readable) {
+            char buffer[4096];
+            const auto size = ::recv(connection.fd.fd(), buffer,
+                                     sizeof(buffer), MSG_DONTWAIT);
+            if (size <= 0) {
+                return false;
+            }
+            connection.buffer.append(buffer, size);
+        }
+
+        const auto end = connection.buffer.find("\r\n\r\n");
+        if (end == std::string::npos) {
+            return true;
+        }
+        auto [latency, response] =
+            handleRequest(connection.buffer.substr(0, end));
+        connection.buffer.erase(0, end + 4);
+        connection.response = std::move(response);
+        connection.due = now + latency;
+        connection.waiting = true;
+        concurrent += 1;
+        const std::lock_guard<std::mutex> lock(mutex_);
+        maxConcurrent_ = std::max(maxConcurrent_, concurrent);
+        return true;
+    }
+
+    fcitx::UnixFD listen_;
+    fcitx::UnixFD wakeupRead_;
+    fcitx::UnixFD wakeupWrite_;
+    uint16_t port_ = 0;
+    std::atomic<int64_t> latency_ = 0;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, size_t> requests_;
+    size_t totalRequests_ = 0;
+    size_t maxConcurrent_ = 0;
+    size_t connections_ = 0;
+    std::thread thread_;
+};
+
+#endif // _TEST_MOCKCLOUDPINYINSERVER_H_
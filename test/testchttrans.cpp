@@ -4,23 +4,91 @@
  * SPDX-License-Identifier: LGPL-2.1-or-later
  *
  */
+#include "../modules/chttrans/chttrans-native.h"
 #include "config.h"
 #include "testdir.h"
 #include "testfrontend_public.h"
 #include "testim_public.h"
+#include <chrono>
+#include <cstdint>
 #include <fcitx-utils/eventdispatcher.h>
+#include <fcitx-utils/fdstreambuf.h>
 #include <fcitx-utils/log.h>
 #include <fcitx-utils/standardpaths.h>
 #include <fcitx-utils/testing.h>
+#include <fcitx-utils/utf8.h>
 #include <fcitx/action.h>
 #include <fcitx/addonmanager.h>
+#include <fcitx/inputcontextmanager.h>
 #include <fcitx/inputmethodgroup.h>
 #include <fcitx/inputmethodmanager.h>
 #include <fcitx/instance.h>
+#include <fcitx/text.h>
 #include <fcitx/userinterfacemanager.h>
+#include <istream>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 using namespace fcitx;
 
+// Page through a candidate list back and forth, with Traditional Chinese
+// enabled, every page goes through the output filter again.
+void benchmarkOutputFilter(Instance *instance, const ICUUID &uuid) {
+    auto *testfrontend = instance->addonManager().addon("testfrontend");
+    auto *ic = instance->inputContextManager().findByUUID(uuid);
+    FCITX_ASSERT(ic);
+    // Conversion is disabled by the last toggle.
+    testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("Control+Shift+F"),
+                                                false);
+    FCITX_ASSERT(instance->outputFilter(ic, Text("皇后")).toString() ==
+                 "皇後");
+
+    constexpr int pageSize = 5;
+    constexpr int pages = 10;
+    std::vector<Text> candidates;
+    for (int i = 0; i < pageSize * pages; i++) {
+        Text text;
+        text.append("简体中文候选词");
+        text.append(std::to_string(i));
+        text.append("号后面的书");
+        candidates.push_back(std::move(text));
+    }
+    auto showPage = [instance, ic, &candidates](int page) {
+        for (int i = page * pageSize; i < (page + 1) * pageSize; i++) {
+            auto text = instance->outputFilter(ic, candidates[i]);
+            FCITX_ASSERT(text.size() == 3);
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for (int page = 0; page < pages; page++) {
+        showPage(page);
+    }
+    auto firstTime = std::chrono::steady_clock::now() - start;
+
+    constexpr int rounds = 100;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        for (int page = pages - 1; page >= 0; page--) {
+            showPage(page);
+        }
+        for (int page = 0; page < pages; page++) {
+            showPage(page);
+        }
+    }
+    auto pagingTime = std::chrono::steady_clock::now() - start;
+
+    auto perPage = [](auto duration, int count) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+                   .count() /
+               count;
+    };
+    FCITX_INFO() << "Output filter per page, first time: "
+                 << perPage(firstTime, pages) << "ns, paging again: "
+                 << perPage(pagingTime, rounds * pages * 2) << "ns";
+}
+
 std::string getTestWord(const std::string &s) {
     std::string result;
     if (s == "a") {
@@ -138,18 +206,95 @@ void scheduleEvent(Instance *instance) {
             uuid, Key("Control+Shift+F"), false);
         testfrontend->call<ITestFrontend::keyEvent>(uuid, Key("f"), false);
 
+        benchmarkOutputFilter(instance, uuid);
+
         instance->exit();
     });
 }
 
 void runInstance() {}
 
+// The old native backend, which looks up every char in a string map.
+std::string mapConvert(const std::unordered_map<std::string, std::string> &map,
+                       const std::string &str) {
+    std::string result;
+    for (const auto &value : utf8::MakeUTF8StringViewRange(str)) {
+        auto iter = map.find(std::string(value));
+        if (iter != map.end()) {
+            result.append(iter->second);
+        } else {
+            result.append(value);
+        }
+    }
+    return result;
+}
+
+void benchmarkNative() {
+    NativeBackend backend;
+    FCITX_ASSERT(backend.load(ChttransConfig()));
+
+    std::unordered_map<std::string, std::string> s2tMap;
+    auto file = StandardPaths::global().open(StandardPathsType::PkgData,
+                                             "chttrans/gbks2t.tab");
+    FCITX_ASSERT(file.isValid());
+    IFDStreamBuf buffer(file.fd());
+    std::istream in(&buffer);
+    std::string line;
+    while (std::getline(in, line)) {
+        uint32_t simp;
+        uint32_t trad;
+        auto tradStart = utf8::getNextChar(line.begin(), line.end(), &simp);
+        auto end = utf8::getNextChar(tradStart, line.end(), &trad);
+        if (utf8::isValidChar(simp) && utf8::isValidChar(trad)) {
+            s2tMap.try_emplace(std::string(line.begin(), tradStart),
+                               tradStart, end);
+        }
+    }
+
+    FCITX_ASSERT(backend.convertSimpToTrad("皇后") == "皇後");
+    FCITX_ASSERT(backend.convertTradToSimp("皇後") == "皇后");
+    FCITX_ASSERT(backend.convertSimpToTrad("") == "");
+
+    // A few MB of Chinese mixed with ASCII.
+    const std::string lines[] = {
+        "简体中文和繁体中文之间的转换测试，这里有很多常用的汉字。\n",
+        "Fcitx 5 is a generic input method framework. 输入法框架\n",
+        "#include <string> // 头文件里的注释也会被转换\n",
+        "    return result; 后面还有一些书写的内容，启动了多个词。\n",
+    };
+    std::string text;
+    while (text.size() < 4 * 1024 * 1024) {
+        for (const auto &line : lines) {
+            text.append(line);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto expected = mapConvert(s2tMap, text);
+    auto mapTime = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    auto result = backend.convertSimpToTrad(text);
+    auto nativeTime = std::chrono::steady_clock::now() - start;
+    FCITX_ASSERT(result == expected);
+
+    auto throughput = [size = text.size()](auto duration) {
+        return size /
+               std::chrono::duration<double>(duration).count() /
+               (1024 * 1024);
+    };
+    FCITX_INFO() << "Convert " << text.size()
+                 << " bytes, string map: " << throughput(mapTime)
+                 << "MB/s, code point table: " << throughput(nativeTime)
+                 << "MB/s";
+}
+
 int main() {
     setupTestingEnvironment(TESTING_BINARY_DIR,
                             {"bin", StandardPaths::fcitxPath("addondir")},
                             {"test", TESTING_SOURCE_DIR "/modules"});
 
     fcitx::Log::setLogRule("*=5");
+    benchmarkNative();
 
     char arg0[] = "testchttrans";
     char arg1[] = "--disable=all";
@@ -0,0 +1,71 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "../modules/cloudpinyin/circuitbreaker.h"
+#include <algorithm>
+#include <cstdint>
+#include <fcitx-utils/log.h>
+
+using State = CircuitBreaker::State;
+
+void testOpenAndRecover() {
+    CircuitBreaker breaker;
+    uint64_t now = 1000;
+    FCITX_ASSERT(breaker.allowRequest(now));
+    FCITX_ASSERT(!breaker.recordFailure(now));
+    FCITX_ASSERT(!breaker.recordFailure(now));
+    // Success in between starts over.
+    FCITX_ASSERT(!breaker.recordSuccess());
+    FCITX_ASSERT(!breaker.recordFailure(now));
+    FCITX_ASSERT(!breaker.recordFailure(now));
+    FCITX_ASSERT(breaker.recordFailure(now));
+    FCITX_ASSERT(breaker.state(now) == State::Open);
+    FCITX_ASSERT(!breaker.allowRequest(now));
+    // Late result of a request sent before it's opened.
+    FCITX_ASSERT(!breaker.recordFailure(now));
+
+    now += CircuitBreaker::InitialBackoff;
+    FCITX_ASSERT(breaker.state(now) == State::HalfOpen);
+    FCITX_ASSERT(breaker.allowRequest(now));
+    // Only one probe.
+    FCITX_ASSERT(!breaker.allowRequest(now));
+    FCITX_ASSERT(breaker.recordSuccess());
+    FCITX_ASSERT(breaker.state(now) == State::Closed);
+    FCITX_ASSERT(breaker.allowRequest(now));
+}
+
+void testBackoff() {
+    CircuitBreaker breaker;
+    uint64_t now = 1000;
+    for (int i = 0; i < CircuitBreaker::FailureThreshold; i++) {
+        breaker.recordFailure(now);
+    }
+    uint64_t backoff = CircuitBreaker::InitialBackoff;
+    for (int i = 0; i < 10; i++) {
+        FCITX_ASSERT(breaker.retryTime() == now + backoff);
+        now = breaker.retryTime();
+        FCITX_ASSERT(breaker.allowRequest(now));
+        FCITX_ASSERT(breaker.recordFailure(now));
+        backoff = std::min(backoff * 2, CircuitBreaker::MaxBackoff);
+    }
+    FCITX_ASSERT(backoff == CircuitBreaker::MaxBackoff);
+
+    // Probe never reports back.
+    now = breaker.retryTime();
+    FCITX_ASSERT(breaker.allowRequest(now));
+    FCITX_ASSERT(!breaker.allowRequest(now + 1));
+    FCITX_ASSERT(breaker.allowRequest(now + CircuitBreaker::ProbeTimeout));
+
+    breaker.reset();
+    FCITX_ASSERT(breaker.state(now) == State::Closed);
+    FCITX_ASSERT(breaker.failures() == 0);
+}
+
+int main() {
+    testOpenAndRecover();
+    testBackoff();
+    return 0;
+}
@@ -5,19 +5,36 @@
  *
  */
 #include "cloudpinyin_public.h"
+#include "mockcloudpinyinserver.h"
 #include "testdir.h"
 #include <cassert>
+#include <cstdlib>
 #include <fcitx-config/rawconfig.h>
 #include <fcitx-utils/event.h>
 #include <fcitx-utils/log.h>
 #include <fcitx-utils/macros.h>
 #include <fcitx-utils/standardpaths.h>
 #include <fcitx-utils/testing.h>
+#include <fcitx/addoninstance.h>
 #include <fcitx/addonmanager.h>
 #include <fcitx/instance.h>
 #include <string>
+#include <vector>
+
+void setBackend(fcitx::AddonInstance *cloudpinyin,
+                const MockCloudPinyinServer &server,
+                const std::string &backend) {
+    fcitx::RawConfig config;
+    config.setValueByPath("Server", server.url());
+    config.setValueByPath("Backend", backend);
+    config.setValueByPath("PersistentCache", "False");
+    cloudpinyin->setConfig(config);
+}
 
 int main() {
+    MockCloudPinyinServer server;
+    // Don't send requests to local server through proxy.
+    setenv("no_proxy", "127.0.0.1", 1);
     fcitx::setupTestingEnvironment(TESTING_BINARY_DIR, {"bin"},
                                    {"test", TESTING_SOURCE_DIR "/modules"});
     fcitx::Log::setLogRule("*=5");
@@ -31,21 +48,42 @@ int main() {
     fcitx::Log::setLogRule("cloudpinyin=5");
 
     int returned = 0;
-    instance.eventDispatcher().schedule([&instance, &returned]() {
-        auto callback = [&instance, &returned](const std::string &pinyin,
-                                               const std::string &hanzi) {
+    instance.eventDispatcher().schedule([&instance, &server, &returned]() {
+        auto *cloudpinyin = instance.addonManager().addon("cloudpinyin", true);
+        auto callback = [&instance, &server, &returned,
+                         cloudpinyin](const std::string &pinyin,
+                                      const std::string &hanzi) {
             FCITX_INFO() << "Pinyin: " << pinyin;
             FCITX_INFO() << "Hanzi: " << hanzi;
+            FCITX_ASSERT(hanzi == "云" + pinyin);
             returned++;
-            if (returned == 1) {
-                instance.exit();
+            if (returned == 3) {
+                setBackend(cloudpinyin, server, "Google");
+                cloudpinyin->call<fcitx::ICloudPinyin::requestCandidates>(
+                    "pinyin", nullptr,
+                    [&instance, &returned](
+                        const std::string &pinyin,
+                        const std::vector<std::string> &candidates) {
+                        FCITX_INFO() << "Candidates: " << candidates;
+                        FCITX_ASSERT(candidates.size() == 2);
+                        FCITX_ASSERT(candidates[0] == "云" + pinyin);
+                        FCITX_ASSERT(candidates[1] == "雲" + pinyin);
+                        returned++;
+                        instance.exit();
+                    });
             }
         };
-        auto *cloudpinyin = instance.addonManager().addon("cloudpinyin", true);
+        setBackend(cloudpinyin, server, "Baidu");
+        cloudpinyin->call<fcitx::ICloudPinyin::request>("nihao", callback);
+        // Shares the request above.
         cloudpinyin->call<fcitx::ICloudPinyin::request>("nihao", callback);
         cloudpinyin->call<fcitx::ICloudPinyin::request>("ceshi", callback);
     });
     instance.exec();
 
+    FCITX_ASSERT(returned == 4);
+    FCITX_ASSERT(server.requests("nihao") == 1);
+    FCITX_ASSERT(server.totalRequests() == 3);
+
     return 0;
 }
@@ -0,0 +1,253 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "cloudpinyin_public.h"
+#include "mockcloudpinyinserver.h"
+#include "testdir.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fcitx-config/rawconfig.h>
+#include <fcitx-utils/eventdispatcher.h>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/macros.h>
+#include <fcitx-utils/testing.h>
+#include <fcitx/addoninstance.h>
+#include <fcitx/addonmanager.h>
+#include <fcitx/instance.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace fcitx;
+using Clock = std::chrono::steady_clock;
+
+// Same as MAX_HANDLE in fetch.h.
+constexpr size_t MaxHandle = 100;
+constexpr auto Latency = std::chrono::milliseconds(20);
+
+/**
+ * Send requests through ICloudPinyin::request and collect the results.
+ *
+ * Each step sends its requests and calls the next step once all of them
+ * are answered.
+ */
+class LoadTest {
+public:
+    LoadTest(Instance *instance, AddonInstance *cloudpinyin,
+             MockCloudPinyinServer *server)
+        : instance_(instance), cloudpinyin_(cloudpinyin), server_(server) {}
+
+    void start() {
+        RawConfig config;
+        config.setValueByPath("Server", server_->url());
+        config.setValueByPath("Backend", "Google");
+        config.setValueByPath("PersistentCache", "False");
+        cloudpinyin_->setConfig(config);
+        server_->setLatency(Latency);
+        testExhaustion();
+    }
+
+private:
+    // Return true if it's answered right away.
+    bool request(const std::string &pinyin, std::function<void()> next) {
+        auto sync = std::make_shared<bool>(true);
+        const size_t answered = syncResults_.size();
+        outstanding_ += 1;
+        cloudpinyin_->call<ICloudPinyin::request>(
+            pinyin, [this, sync, start = Clock::now(),
+                     next = std::move(next)](const std::string &pinyin,
+                                             const std::string &hanzi) {
+                outstanding_ -= 1;
+                if (*sync) {
+                    syncResults_.push_back(hanzi);
+                    return;
+                }
+                if (pinyin.starts_with("error")) {
+                    FCITX_ASSERT(hanzi.empty());
+                } else {
+                    FCITX_ASSERT(hanzi == "云" + pinyin) << pinyin;
+                    latencies_.push_back(Clock::now() - start);
+                }
+                if (next) {
+                    next();
+                }
+            });
+        *sync = false;
+        return syncResults_.size() != answered;
+    }
+
+    void whenDone(std::function<void()> next) {
+        if (outstanding_ == 0) {
+            instance_->eventDispatcher().schedule(std::move(next));
+        } else {
+            done_ = std::move(next);
+        }
+    }
+
+    void checkDone() {
+        if (outstanding_ == 0 && done_) {
+            auto done = std::move(done_);
+            done_ = nullptr;
+            instance_->eventDispatcher().schedule(std::move(done));
+        }
+    }
+
+    // Requests more than handles fail right away, and the same pinyin
+    // shares the request.
+    void testExhaustion() {
+        constexpr size_t total = 2000;
+        for (size_t i = 0; i < total; i++) {
+            const auto pinyin = "load" + std::to_string(i);
+            for (int j = 0; j < 2; j++) {
+                request(pinyin, [this]() { checkDone(); });
+            }
+        }
+        FCITX_ASSERT(syncResults_.size() == 2 * (total - MaxHandle))
+            << syncResults_.size();
+        FCITX_ASSERT(std::ranges::all_of(
+            syncResults_, [](const std::string &hanzi) {
+                return hanzi.empty();
+            }));
+        whenDone([this]() {
+            FCITX_ASSERT(server_->totalRequests() == MaxHandle)
+                << server_->totalRequests();
+            FCITX_ASSERT(server_->maxConcurrent() <= MaxHandle);
+            FCITX_ASSERT(server_->requests("load0") == 1);
+            FCITX_ASSERT(latencies_.size() == 2 * MaxHandle);
+            FCITX_INFO() << "Connections: " << server_->connections();
+            reportLatency("Burst");
+            testThroughput();
+        });
+    }
+
+    // Keep the handles busy with repeated pinyin, results are shared or
+    // cached after the first request.
+    void testThroughput() {
+        server_->resetStats();
+        syncResults_.clear();
+        latencies_.clear();
+        pump();
+        whenDone([this]() {
+            const size_t hits = syncResults_.size();
+            FCITX_INFO() << "Cache hit rate: " << hits * 100 / ThroughputTotal
+                         << "%";
+            FCITX_ASSERT(server_->totalRequests() == ThroughputUnique)
+                << server_->totalRequests();
+            FCITX_ASSERT(server_->maxConcurrent() <= ThroughputWindow);
+            FCITX_ASSERT(hits >= ThroughputTotal - 2 * ThroughputUnique)
+                << hits;
+            FCITX_ASSERT(std::ranges::all_of(
+                syncResults_, [](const std::string &hanzi) {
+                    return hanzi.starts_with("云");
+                }));
+            reportLatency("Throughput");
+            testErrors();
+        });
+    }
+
+    void pump() {
+        while (sent_ < ThroughputTotal && outstanding_ < ThroughputWindow) {
+            // Every pinyin is requested twice in a row, then again from the
+            // cache.
+            const auto pinyin =
+                "word" + std::to_string((sent_ / 2) % ThroughputUnique);
+            sent_ += 1;
+            request(pinyin, [this]() {
+                pump();
+                checkDone();
+            });
+        }
+    }
+
+    // Failing backend is not used until the breaker allows a probe. A
+    // response that is not JSON is also a failure.
+    void testErrors() {
+        server_->resetStats();
+        for (int i = 0; i < 5; i++) {
+            request((i < 3 ? "error" : "portal") + std::to_string(i),
+                    [this]() { checkDone(); });
+        }
+        whenDone([this]() {
+            FCITX_ASSERT(server_->totalRequests() == 5);
+            syncResults_.clear();
+            FCITX_ASSERT(request("afterfailure", nullptr));
+            FCITX_ASSERT(syncResults_.back().empty());
+            FCITX_ASSERT(server_->totalRequests() == 5);
+            const auto status =
+                cloudpinyin_->call<ICloudPinyin::backendStatus>();
+            FCITX_INFO() << status;
+            FCITX_ASSERT(status.find("Google: open") != std::string::npos);
+            FCITX_ASSERT(status.find("http=3") != std::string::npos);
+            FCITX_ASSERT(status.find("parse=2") != std::string::npos);
+
+            cloudpinyin_->call<ICloudPinyin::resetError>();
+            FCITX_ASSERT(!request("afterreset", [this]() {
+                FCITX_ASSERT(server_->requests("afterreset") == 1);
+                instance_->exit();
+            }));
+        });
+    }
+
+    void reportLatency(const std::string &name) {
+        std::ranges::sort(latencies_);
+        auto percentile = [this](size_t percent) {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                       latencies_[(latencies_.size() - 1) * percent / 100])
+                .count();
+        };
+        FCITX_INFO() << name << " latency p50: " << percentile(50)
+                     << "ms p90: " << percentile(90)
+                     << "ms p99: " << percentile(99) << "ms";
+        // Shared requests may start later than the first one.
+        FCITX_ASSERT(latencies_[latencies_.size() / 2] >= Latency);
+        // Generous for slow test machines, far below the request timeout.
+        FCITX_ASSERT(latencies_.back() < std::chrono::seconds(5));
+    }
+
+    static constexpr size_t ThroughputTotal = 6000;
+    static constexpr size_t ThroughputUnique = 1000;
+    static constexpr size_t ThroughputWindow = MaxHandle / 2;
+
+    Instance *instance_;
+    AddonInstance *cloudpinyin_;
+    MockCloudPinyinServer *server_;
+    size_t outstanding_ = 0;
+    size_t sent_ = 0;
+    std::function<void()> done_;
+    // Results that are returned before request() returns.
+    std::vector<std::string> syncResults_;
+    std::vector<Clock::duration> latencies_;
+};
+
+int main() {
+    MockCloudPinyinServer server;
+    // Don't send requests to local server through proxy.
+    setenv("no_proxy", "127.0.0.1", 1);
+    setupTestingEnvironment(TESTING_BINARY_DIR, {"bin"},
+                            {"test", TESTING_SOURCE_DIR "/modules"});
+
+    char arg0[] = "testcloudpinyinload";
+    char arg1[] = "--disable=all";
+    char arg2[] = "--enable=cloudpinyin";
+    char *argv[] = {arg0, arg1, arg2};
+    Instance instance(FCITX_ARRAY_SIZE(argv), argv);
+    instance.addonManager().registerDefaultLoader(nullptr);
+
+    std::unique_ptr<LoadTest> test;
+    instance.eventDispatcher().schedule([&instance, &server, &test]() {
+        auto *cloudpinyin = instance.addonManager().addon("cloudpinyin", true);
+        FCITX_ASSERT(cloudpinyin);
+        test = std::make_unique<LoadTest>(&instance, cloudpinyin, &server);
+        test->start();
+    });
+    instance.exec();
+
+    return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "../modules/cloudpinyin/completionqueue.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/unixfd.h>
+#include <fcntl.h>
+#include <functional>
+#include <mutex>
+#include <poll.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t Producers = 4;
+constexpr size_t ItemsPerProducer = 200000;
+constexpr size_t Total = Producers * ItemsPerProducer;
+
+struct Item : public CompletionQueueNode {
+    size_t producer = 0;
+    size_t sequence = 0;
+};
+
+// Pipe to wake up the consumer, like the event dispatcher does.
+class Wakeup {
+public:
+    Wakeup() {
+        int fds[2];
+        FCITX_ASSERT(::pipe2(fds, O_CLOEXEC | O_NONBLOCK) == 0);
+        read_.give(fds[0]);
+        write_.give(fds[1]);
+    }
+
+    void notify() {
+        const char c = 0;
+        // Pipe may be full, the consumer is woken up anyway.
+        [[maybe_unused]] const auto written = ::write(write_.fd(), &c, 1);
+    }
+
+    void wait() {
+        pollfd fd{read_.fd(), POLLIN, 0};
+        ::poll(&fd, 1, -1);
+        char buffer[256];
+        while (::read(read_.fd(), buffer, sizeof(buffer)) > 0) {
+        }
+    }
+
+private:
+    fcitx::UnixFD read_;
+    fcitx::UnixFD write_;
+};
+
+// Push items from Producers threads, consume until all are received and
+// return the time it takes.
+Clock::duration run(const std::function<void(Item *)> &push,
+                    const std::function<size_t(std::vector<size_t> &)> &drain,
+                    Wakeup &wakeup) {
+    std::vector<Item> items(Total);
+    std::vector<std::thread> threads;
+    const auto start = Clock::now();
+    for (size_t i = 0; i < Producers; i++) {
+        threads.emplace_back([&items, &push, i]() {
+            for (size_t j = 0; j < ItemsPerProducer; j++) {
+                auto &item = items[i * ItemsPerProducer + j];
+                item.producer = i;
+                item.sequence = j;
+                push(&item);
+            }
+        });
+    }
+    // Next expected sequence of each producer.
+    std::vector<size_t> next(Producers, 0);
+    size_t received = 0;
+    while (received < Total) {
+        wakeup.wait();
+        received += drain(next);
+    }
+    const auto elapsed = Clock::now() - start;
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (const auto value : next) {
+        FCITX_ASSERT(value == ItemsPerProducer);
+    }
+    return elapsed;
+}
+
+void check(std::vector<size_t> &next, const Item *item) {
+    FCITX_ASSERT(next[item->producer] == item->sequence)
+        << item->producer << " " << item->sequence;
+    next[item->producer] += 1;
+}
+
+Clock::duration testCompletionQueue() {
+    CompletionQueue<Item> queue;
+    Wakeup wakeup;
+    std::atomic<size_t> wakeups = 0;
+    size_t batches = 0;
+    const auto elapsed = run(
+        [&queue, &wakeup, &wakeups](Item *item) {
+            if (queue.push(item)) {
+                wakeups += 1;
+                wakeup.notify();
+            }
+        },
+        [&queue, &batches](std::vector<size_t> &next) {
+            const size_t count =
+                queue.drain([&next](Item *item) { check(next, item); });
+            batches += count ? 1 : 0;
+            return count;
+        },
+        wakeup);
+    FCITX_ASSERT(queue.empty());
+    // Every push onto an empty queue is followed by a drain that is not
+    // empty, unless an earlier drain takes it.
+    FCITX_ASSERT(batches <= wakeups);
+    FCITX_ASSERT(wakeups <= Total);
+    FCITX_INFO() << "Completion queue: " << wakeups << " wakeups, "
+                 << Total / std::max<size_t>(batches, 1)
+                 << " items per batch";
+    return elapsed;
+}
+
+// Mutex and a wakeup for every item, as it was before.
+Clock::duration testLockedQueue() {
+    std::mutex mutex;
+    std::deque<Item *> queue;
+    Wakeup wakeup;
+    return run(
+        [&mutex, &queue, &wakeup](Item *item) {
+            {
+                const std::lock_guard<std::mutex> lock(mutex);
+                queue.push_back(item);
+            }
+            wakeup.notify();
+        },
+        [&mutex, &queue](std::vector<size_t> &next) {
+            size_t count = 0;
+            while (true) {
+                Item *item;
+                {
+                    const std::lock_guard<std::mutex> lock(mutex);
+                    if (queue.empty()) {
+                        break;
+                    }
+                    item = queue.front();
+                    queue.pop_front();
+                }
+                check(next, item);
+                count += 1;
+            }
+            return count;
+        },
+        wakeup);
+}
+
+void testOrder() {
+    CompletionQueue<Item> queue;
+    std::vector<Item> items(3);
+    FCITX_ASSERT(queue.push(&items[0]));
+    FCITX_ASSERT(!queue.push(&items[1]));
+    size_t count = queue.drain([&queue, &items](Item *item) {
+        FCITX_ASSERT(item == &items[0] || item == &items[1]);
+        if (item == &items[0]) {
+            // Pushed during drain, handled by the next one.
+            FCITX_ASSERT(queue.push(&items[2]));
+        }
+    });
+    FCITX_ASSERT(count == 2);
+    count = queue.drain([&items](Item *item) {
+        FCITX_ASSERT(item == &items[2]);
+    });
+    FCITX_ASSERT(count == 1);
+    FCITX_ASSERT(queue.empty());
+    FCITX_ASSERT(queue.drain([](Item *) { FCITX_ASSERT(false); }) == 0);
+}
+
+int main() {
+    testOrder();
+    const auto lockFree = testCompletionQueue();
+    const auto locked = testLockedQueue();
+    auto perSecond = [](Clock::duration elapsed) {
+        const auto us =
+            std::chrono::duration_cast<std::chrono::microseconds>(elapsed)
+                .count();
+        return Total * 1000000 / std::max<size_t>(us, 1);
+    };
+    FCITX_INFO() << "Completion queue: " << perSecond(lockFree)
+                 << " items/s, locked queue: " << perSecond(locked)
+                 << " items/s";
+    return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "../im/pinyin/englishness.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <fcitx-utils/charutils.h>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/stringutils.h>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+using namespace fcitx;
+
+// The old implementation, which splits the input into strings.
+std::tuple<bool, int> splitEnglishNess(const std::string &input, bool sp) {
+    const auto pys = stringutils::split(input, " ");
+    constexpr int fullWeight = -2;
+    constexpr int shortWeight = 3;
+    constexpr int invalidWeight = 6;
+    constexpr int defaultWeight = shortWeight;
+    int weight = 0;
+    if (std::any_of(input.begin(), input.end(), charutils::isupper)) {
+        return {true,
+                std::max<size_t>(1, (invalidWeight * pys.size() + 7) / 10)};
+    }
+
+    for (const auto &py : pys) {
+        if (sp) {
+            if (py.size() == 2) {
+                weight += fullWeight / 2;
+            } else {
+                weight += invalidWeight;
+            }
+        } else {
+            if (py == "ng") {
+                weight += fullWeight;
+            } else {
+                auto firstChr = py[0];
+                if (firstChr == '\'') {
+                    return {false, 0};
+                }
+                if (firstChr == 'i' || firstChr == 'u' || firstChr == 'v') {
+                    weight += invalidWeight;
+                } else if (py.size() <= 2) {
+                    weight += shortWeight;
+                } else if (py.find_first_of("aeiou") != std::string::npos) {
+                    weight += fullWeight;
+                } else {
+                    weight += defaultWeight;
+                }
+            }
+        }
+    }
+
+    if (weight < 0) {
+        return {false, 0};
+    }
+    return {false, (weight + 7) / 10};
+}
+
+// Raw text preedit of some pinyin and English input.
+const std::vector<std::string> inputs{
+    "",
+    "ni hao",
+    "zhong guo ren",
+    "c o m p u t e r",
+    "i n t e r n e t",
+    "ng",
+    "x ian",
+    "xi 'an",
+    "A p p l e",
+    "i P h o n e",
+    "  ni  hao ",
+    "ni h",
+    "sh j",
+    "ts",
+    "ab cd ef",
+};
+
+void testEnglishNess() {
+    for (const auto &input : inputs) {
+        for (bool sp : {false, true}) {
+            FCITX_ASSERT(englishNess(input, sp) == splitEnglishNess(input, sp))
+                << input << " " << sp;
+        }
+    }
+    FCITX_ASSERT(std::get<0>(englishNess("A p p l e", false)));
+    FCITX_ASSERT(std::get<1>(englishNess("c o m p u t e r", false)) > 0);
+    FCITX_ASSERT(std::get<1>(englishNess("ni hao", false)) == 0);
+}
+
+// Typing each input char by char, like updateUI does on every key.
+void benchmark() {
+    constexpr int rounds = 2000;
+    size_t keystrokes = 0;
+    int splitSum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        for (const auto &input : inputs) {
+            for (size_t j = 1; j <= input.size(); j++) {
+                splitSum +=
+                    std::get<1>(splitEnglishNess(input.substr(0, j), false));
+                keystrokes += 1;
+            }
+        }
+    }
+    auto splitTime = std::chrono::steady_clock::now() - start;
+
+    int sum = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        for (const auto &input : inputs) {
+            for (size_t j = 1; j <= input.size(); j++) {
+                sum += std::get<1>(
+                    englishNess(std::string_view(input).substr(0, j), false));
+            }
+        }
+    }
+    auto time = std::chrono::steady_clock::now() - start;
+    FCITX_ASSERT(sum == splitSum);
+
+    auto perKey = [keystrokes](auto duration) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+                   .count() /
+               static_cast<double>(keystrokes);
+    };
+    FCITX_INFO() << "englishNess per keystroke, split: " << perKey(splitTime)
+                 << "ns, string_view: " << perKey(time) << "ns";
+}
+
+int main() {
+    testEnglishNess();
+    benchmark();
+    return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "../modules/cloudpinyin/jsontokenizer.h"
+#include <cstddef>
+#include <fcitx-utils/log.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Values as "path=value", path is like /1/0/key.
+std::vector<std::string> tokenize(std::string_view json, size_t chunk,
+                                  bool *finished = nullptr) {
+    std::vector<std::string> values;
+    JsonTokenizer tokenizer([&values](const JsonPath &path,
+                                      std::string_view value, bool isString) {
+        std::string item;
+        for (const auto &level : path) {
+            item.push_back('/');
+            item.append(level.object ? level.key
+                                     : std::to_string(level.index));
+        }
+        item.push_back('=');
+        if (isString) {
+            item.push_back('"');
+            item.append(value);
+            item.push_back('"');
+        } else {
+            item.append(value);
+        }
+        values.push_back(std::move(item));
+    });
+    bool ok = true;
+    for (size_t i = 0; i < json.size() && ok; i += chunk) {
+        ok = tokenizer.feed(json.substr(i, chunk));
+    }
+    if (!ok) {
+        FCITX_ASSERT(tokenizer.failed());
+        values.push_back("error");
+    }
+    if (finished) {
+        *finished = tokenizer.finished();
+    }
+    return values;
+}
+
+void testGoogle() {
+    const std::string_view json =
+        R"(["SUCCESS",[["nihao",["你好","拟好"],[],{"annotation":[]}]]])";
+    const std::vector<std::string> expected = {
+        R"(/0="SUCCESS")", R"(/1/0/0="nihao")", R"(/1/0/1/0="你好")",
+        R"(/1/0/1/1="拟好")"};
+    // Any split of the data gives the same result.
+    for (size_t chunk = 1; chunk <= json.size(); chunk++) {
+        bool finished = false;
+        FCITX_ASSERT(tokenize(json, chunk, &finished) == expected) << chunk;
+        FCITX_ASSERT(finished);
+    }
+}
+
+void testBaidu() {
+    const std::string_view json =
+        R"({"0": [[["你好", 5, {"pinyin": "ni'hao"}]]], "1": "nihao",)"
+        R"( "status": "T", "ok": true, "x": -1.5e3, "y": null})";
+    const std::vector<std::string> expected = {
+        R"(/0/0/0/0="你好")", "/0/0/0/1=5", R"(/0/0/0/2/pinyin="ni'hao")",
+        R"(/1="nihao")",      R"(/status="T")", "/ok=true",
+        "/x=-1.5e3",          "/y=null"};
+    bool finished = false;
+    FCITX_ASSERT(tokenize(json, 3, &finished) == expected);
+    FCITX_ASSERT(finished);
+}
+
+void testEscape() {
+    const std::string_view json =
+        R"(["a\"b\\\/\n", "你好", "\ud83d\ude00", [], {}])";
+    const std::vector<std::string> expected = {
+        "/0=\"a\"b\\/\n\"", R"(/1="你好")", "/2=\"\xf0\x9f\x98\x80\""};
+    for (size_t chunk = 1; chunk <= 4; chunk++) {
+        FCITX_ASSERT(tokenize(json, chunk) == expected) << chunk;
+    }
+}
+
+void testInvalid() {
+    for (std::string_view json :
+         {R"([1,])", R"({"a" 1})", R"(["\x"])", R"(["\ud83d"])",
+          R"(["\ude00"])", R"([tru])", R"([1]])", R"(<html>)",
+          "[\"a\nb\"]"}) {
+        const auto values = tokenize(json, 1);
+        FCITX_ASSERT(!values.empty() && values.back() == "error") << json;
+    }
+    // Not finished yet.
+    bool finished = true;
+    FCITX_ASSERT(tokenize(R"(["a", [)", 1, &finished).size() == 1);
+    FCITX_ASSERT(!finished);
+    // Too long.
+    const std::string json =
+        "[\"" + std::string(JsonTokenizer::MaxValueLength + 1, 'a') + "\"]";
+    FCITX_ASSERT(tokenize(json, 100).back() == "error");
+}
+
+int main() {
+    testGoogle();
+    testBaidu();
+    testEscape();
+    testInvalid();
+    return 0;
+}
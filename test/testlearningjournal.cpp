@@ -0,0 +1,164 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "../common/learningjournal.h"
+#include <cstdlib>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/standardpaths.h>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <vector>
+
+using namespace fcitx;
+
+std::vector<LearningJournal::Operation> replay(LearningJournal &journal) {
+    std::vector<LearningJournal::Operation> result;
+    journal.replay([&result](const LearningJournal::Operation &op) {
+        result.push_back(op);
+    });
+    return result;
+}
+
+void testAppendAndReplay() {
+    const LearningJournal::Operation op1{"learn", "你好", "ni'hao"};
+    const LearningJournal::Operation op2{"add", "a\tb", "c\nd\\"};
+    {
+        LearningJournal journal("test/user.journal");
+        FCITX_ASSERT(replay(journal).empty());
+        journal.append(op1);
+        journal.append(op2);
+        FCITX_ASSERT(journal.size() == 2);
+    }
+
+    LearningJournal journal("test/user.journal");
+    auto ops = replay(journal);
+    FCITX_ASSERT(ops.size() == 2);
+    FCITX_ASSERT(ops[0] == op1);
+    FCITX_ASSERT(ops[1] == op2) << ops[1];
+    FCITX_ASSERT(journal.size() == 2);
+}
+
+void testIncompleteLine() {
+    const auto path =
+        StandardPaths::global().userDirectory(StandardPathsType::PkgData) /
+        "test/user.journal";
+    {
+        std::ofstream out(path, std::ios::out | std::ios::app);
+        out << "forget\tbroken";
+    }
+    LearningJournal journal("test/user.journal");
+    FCITX_ASSERT(replay(journal).size() == 2);
+    journal.append({"forget", "x"});
+    auto ops = replay(journal);
+    FCITX_ASSERT(ops.size() == 3);
+    FCITX_ASSERT(ops[2] == LearningJournal::Operation({"forget", "x"}));
+}
+
+void testRotate() {
+    LearningJournal journal("test/user.journal");
+    replay(journal);
+    FCITX_ASSERT(journal.rotate());
+    // Previous compaction is not finished yet.
+    journal.append({"forget", "y"});
+    FCITX_ASSERT(!journal.rotate());
+    FCITX_ASSERT(journal.size() == 1);
+
+    // Failed compaction keeps old operations before new ones.
+    journal.finishRotate(false);
+    FCITX_ASSERT(journal.size() == 4);
+    FCITX_ASSERT(replay(journal).size() == 4);
+    FCITX_ASSERT(journal.rotate());
+    journal.append({"forget", "z"});
+    auto ops = replay(journal);
+    FCITX_ASSERT(ops.size() == 5);
+    FCITX_ASSERT(ops[3] == LearningJournal::Operation({"forget", "y"}));
+    FCITX_ASSERT(ops[4] == LearningJournal::Operation({"forget", "z"}));
+
+    journal.removeRotatedTask()();
+    journal.finishRotate(true);
+    ops = replay(journal);
+    FCITX_ASSERT(ops.size() == 1);
+    FCITX_ASSERT(ops[0] == LearningJournal::Operation({"forget", "z"}));
+    FCITX_ASSERT(journal.syncTask()());
+}
+
+// Crash after user data and compacted generation are saved, but before the
+// old operations are removed.
+void testCompactedNotReplayed() {
+    const auto dir =
+        StandardPaths::global().userDirectory(StandardPathsType::PkgData) /
+        "test";
+    const auto rotated = dir / "crash.journal.old";
+    const auto backup = dir / "crash.journal.backup";
+    {
+        LearningJournal journal("test/crash.journal");
+        FCITX_ASSERT(replay(journal).empty());
+        journal.append({"history", "a"});
+        FCITX_ASSERT(journal.rotate());
+        journal.append({"history", "b"});
+        std::filesystem::copy_file(rotated, backup);
+        journal.removeRotatedTask()();
+        journal.finishRotate(true);
+        FCITX_ASSERT(!std::filesystem::exists(rotated));
+        std::filesystem::rename(backup, rotated);
+    }
+    {
+        LearningJournal journal("test/crash.journal");
+        auto ops = replay(journal);
+        FCITX_ASSERT(ops.size() == 1);
+        FCITX_ASSERT(ops[0] == LearningJournal::Operation({"history", "b"}));
+        FCITX_ASSERT(!std::filesystem::exists(rotated));
+
+        // Failed compaction is still replayed.
+        FCITX_ASSERT(journal.rotate());
+        journal.finishRotate(false);
+        journal.append({"history", "c"});
+        FCITX_ASSERT(journal.rotate());
+        std::filesystem::copy_file(rotated, backup);
+    }
+    LearningJournal journal("test/crash.journal");
+    auto ops = replay(journal);
+    FCITX_ASSERT(ops.size() == 2);
+    FCITX_ASSERT(ops[1] == LearningJournal::Operation({"history", "c"}));
+    // Generation of the appended operations is the old one, so they are
+    // not replayed either once it's compacted.
+    FCITX_ASSERT(journal.rotate());
+    journal.removeRotatedTask()();
+    journal.finishRotate(true);
+    std::filesystem::rename(backup, rotated);
+    LearningJournal restarted("test/crash.journal");
+    FCITX_ASSERT(replay(restarted).empty());
+}
+
+// Engine may fail to load its data, and never replay.
+void testRotateWithoutReplay() {
+    {
+        LearningJournal journal("test/noreplay.journal");
+        replay(journal);
+        journal.append({"history", "a"});
+    }
+    LearningJournal journal("test/noreplay.journal");
+    journal.append({"history", "b"});
+    FCITX_ASSERT(!journal.rotate());
+    FCITX_ASSERT(replay(journal).size() == 2);
+    FCITX_ASSERT(journal.rotate());
+}
+
+int main() {
+    char dir[] = "/tmp/testlearningjournalXXXXXX";
+    FCITX_ASSERT(mkdtemp(dir));
+    setenv("XDG_DATA_HOME", dir, 1);
+
+    testAppendAndReplay();
+    testIncompleteLine();
+    testRotate();
+    testCompactedNotReplayed();
+    testRotateWithoutReplay();
+
+    std::filesystem::remove_all(dir);
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "../modules/cloudpinyin/persistentcache.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/standardpaths.h>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace fcitx;
+
+using Candidates = std::vector<std::string>;
+
+constexpr int64_t ttl = 100;
+
+std::filesystem::path cachePath() {
+    return StandardPaths::global().userDirectory(StandardPathsType::PkgData) /
+           "test/google.cache";
+}
+
+// Same as the addon, but without the background thread.
+void load(PersistentCache &cache, int64_t now) {
+    cache.loadTask(now, [&cache](PersistentCache::Content content) {
+        cache.setLoaded(std::move(content));
+    })();
+    FCITX_ASSERT(cache.loaded());
+}
+
+void testSaveAndLoad() {
+    {
+        PersistentCache cache("test/google.cache", 3, ttl);
+        load(cache, 1000);
+        FCITX_ASSERT(!cache.find("nihao", 1000));
+        FCITX_ASSERT(!cache.dirty());
+        cache.insert("nihao", {"你好"}, 1000);
+        cache.insert("ceshi", {"测试", "侧视"}, 1000);
+        FCITX_ASSERT(cache.dirty());
+        cache.flushTask()();
+        FCITX_ASSERT(!cache.dirty());
+        // Later one wins.
+        cache.insert("nihao", {"拟好"}, 1001);
+        // Not something the file can hold.
+        cache.insert("xinhang", {"a\nb"}, 1001);
+        cache.insert("kongge", {"a", "b\tc"}, 1001);
+        cache.insert("kong", {}, 1001);
+        cache.flushTask()();
+    }
+
+    PersistentCache cache("test/google.cache", 3, ttl);
+    // Not loaded yet.
+    FCITX_ASSERT(!cache.find("nihao", 1050));
+    load(cache, 1050);
+    FCITX_ASSERT(*cache.find("nihao", 1050) == Candidates{"拟好"});
+    FCITX_ASSERT(*cache.find("ceshi", 1050) ==
+                 (Candidates{"测试", "侧视"}));
+    FCITX_ASSERT(!cache.find("xinhang", 1050));
+    FCITX_ASSERT(!cache.find("kongge", 1050));
+    FCITX_ASSERT(!cache.find("kong", 1050));
+    // Expired.
+    FCITX_ASSERT(!cache.find("ceshi", 1200));
+}
+
+void testCompact() {
+    {
+        PersistentCache cache("test/google.cache", 3, ttl);
+        load(cache, 1200);
+        for (int i = 0; i < 5; i++) {
+            cache.insert("py" + std::to_string(i), {"hz"}, 1200);
+        }
+        cache.flushTask()();
+    }
+    size_t lines = 0;
+    {
+        std::ifstream in(cachePath(), std::ios::in | std::ios::binary);
+        std::string line;
+        while (std::getline(in, line)) {
+            lines += 1;
+        }
+    }
+    FCITX_ASSERT(lines == 3) << lines;
+
+    // Previous run stopped in the middle of a line.
+    {
+        std::ofstream out(cachePath(), std::ios::out | std::ios::app);
+        out << "1200\tbroken";
+    }
+    {
+        PersistentCache cache("test/google.cache", 3, ttl);
+        // Newer than the one in the file.
+        cache.insert("py4", {"new"}, 1200);
+        load(cache, 1200);
+        FCITX_ASSERT(*cache.find("py4", 1200) == Candidates{"new"});
+        FCITX_ASSERT(*cache.find("py3", 1200) == Candidates{"hz"});
+        FCITX_ASSERT(!cache.find("py1", 1200));
+        cache.flushTask()();
+    }
+    PersistentCache cache("test/google.cache", 3, ttl);
+    load(cache, 1200);
+    FCITX_ASSERT(*cache.find("py4", 1200) == Candidates{"new"});
+    FCITX_ASSERT(*cache.find("py2", 1200) == Candidates{"hz"});
+    FCITX_ASSERT(!cache.find("broken", 1200));
+
+    PersistentCache::removeTask("test/google.cache")();
+    FCITX_ASSERT(!std::filesystem::exists(cachePath()));
+}
+
+void testRemoveAll() {
+    for (const auto *name : {"test/google.cache", "test/google-server.cache"}) {
+        PersistentCache cache(name, 3, ttl);
+        load(cache, 1000);
+        cache.insert("py", {"hz"}, 1000);
+        cache.flushTask()();
+    }
+    const auto other = cachePath().parent_path() / "other";
+    std::ofstream(other) << "other";
+
+    PersistentCache::removeAllTask("test")();
+    FCITX_ASSERT(!std::filesystem::exists(cachePath()));
+    FCITX_ASSERT(!std::filesystem::exists(cachePath().parent_path() /
+                                          "google-server.cache"));
+    FCITX_ASSERT(std::filesystem::exists(other));
+}
+
+int main() {
+    char dir[] = "/tmp/testpersistentcacheXXXXXX";
+    FCITX_ASSERT(mkdtemp(dir));
+    setenv("XDG_DATA_HOME", dir, 1);
+
+    testSaveAndLoad();
+    testCompact();
+    testRemoveAll();
+
+    std::filesystem::remove_all(dir);
+    return 0;
+}
@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: LGPL-2.1-or-later
  *
  */
+#include "../im/pinyin/pinyin_public.h"
 #include "testdir.h"
 #include "testfrontend_public.h"
 #include <algorithm>
@@ -12,6 +13,7 @@
 #include <fcitx-utils/event.h>
 #include <fcitx-utils/eventdispatcher.h>
 #include <fcitx-utils/eventloopinterface.h>
+#include <fcitx-utils/handlertable.h>
 #include <fcitx-utils/key.h>
 #include <fcitx-utils/keysym.h>
 #include <fcitx-utils/log.h>
@@ -32,7 +34,9 @@
 using namespace fcitx;
 
 std::unique_ptr<EventSourceTime> endTestEvent;
+std::unique_ptr<HandlerTableEntry<PinyinReadyCallback>> readyWatcher;
 void testPunctuationPart2(Instance *instance);
+void runTests(Instance *instance);
 
 int findCandidate(InputContext *ic, std::string_view word) {
     auto candList = ic->inputPanel().candidateList();
@@ -72,6 +76,7 @@ void sendControlSpace(AddonInstance *testfrontend, InputContext *ic) {
 
 void setup(Instance *instance) {
     instance->eventDispatcher().schedule([instance]() {
+        const auto start = now(CLOCK_MONOTONIC);
         auto *pinyin = instance->addonManager().addon("pinyin", true);
         FCITX_ASSERT(pinyin);
         auto defaultGroup = instance->inputMethodManager().currentGroup();
@@ -84,6 +89,42 @@ void setup(Instance *instance) {
             InputMethodGroupItem("shuangpin"));
         defaultGroup.setDefaultInputMethod("");
         instance->inputMethodManager().setGroup(std::move(defaultGroup));
+
+        // Dictionaries are loaded in background, type something right away
+        // to measure how long it takes to see any candidate.
+        auto *testfrontend = instance->addonManager().addon("testfrontend");
+        auto uuid =
+            testfrontend->call<ITestFrontend::createInputContext>("testapp");
+        auto *ic = instance->inputContextManager().findByUUID(uuid);
+        FCITX_ASSERT(ic);
+        instance->setCurrentInputMethod(ic, "pinyin", true);
+        for (const auto *key : {"n", "i", "h", "a", "o"}) {
+            testfrontend->call<ITestFrontend::keyEvent>(uuid, Key(key), false);
+        }
+        FCITX_ASSERT(ic->inputPanel().candidateList());
+        FCITX_ASSERT(!ic->inputPanel().candidateList()->empty());
+        FCITX_INFO() << "Time to first candidate: "
+                     << now(CLOCK_MONOTONIC) - start << "us";
+
+        auto checkReady = [instance, uuid, start]() {
+            auto *ic = instance->inputContextManager().findByUUID(uuid);
+            FCITX_ASSERT(ic);
+            FCITX_INFO() << "Time to ready: " << now(CLOCK_MONOTONIC) - start
+                         << "us";
+            // Pending input is refreshed with real candidates.
+            findCandidateOrDie(ic, "你好");
+            ic->reset();
+            runTests(instance);
+        };
+        if (pinyin->call<IPinyinEngine::ready>()) {
+            checkReady();
+        } else {
+            readyWatcher = pinyin->call<IPinyinEngine::watchReady>(
+                [instance, checkReady]() {
+                    // Don't run the tests inside the ready callback.
+                    instance->eventDispatcher().schedule(checkReady);
+                });
+        }
     });
 }
 
@@ -514,6 +555,18 @@ void testPunctuationPart2(Instance *instance) {
     });
 }
 
+void runTests(Instance *instance) {
+    testBasic(instance);
+    testSelectByChar(instance);
+    testUppercase(instance);
+    testForget(instance);
+    testActionInStrokeFilter(instance);
+    testPin(instance);
+    testQuickPhraseTrigger(instance);
+    testVQuickPhraseTrigger(instance);
+    testPunctuation(instance);
+}
+
 int main() {
     setupTestingEnvironment(
         TESTING_BINARY_DIR, {"bin"},
@@ -530,16 +583,8 @@ int main() {
     Instance instance(FCITX_ARRAY_SIZE(argv), argv);
     instance.addonManager().registerDefaultLoader(nullptr);
     setup(&instance);
-    testBasic(&instance);
-    testSelectByChar(&instance);
-    testUppercase(&instance);
-    testForget(&instance);
-    testActionInStrokeFilter(&instance);
-    testPin(&instance);
-    testQuickPhraseTrigger(&instance);
-    testVQuickPhraseTrigger(&instance);
-    testPunctuation(&instance);
     instance.exec();
+    readyWatcher.reset();
     endTestEvent.reset();
     return 0;
 }
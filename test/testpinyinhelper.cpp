@@ -6,10 +6,30 @@
  */
 #include "pinyinhelper_public.h"
 #include "testdir.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <fcitx-utils/log.h>
 #include <fcitx-utils/testing.h>
 #include <fcitx-utils/utf8.h>
 #include <fcitx/addonmanager.h>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// Resident set size of this process in kB, 0 if it is not known.
+long residentSize() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.starts_with("VmRSS:")) {
+            return std::stol(line.substr(6));
+        }
+    }
+    return 0;
+}
 
 int main() {
     fcitx::setupTestingEnvironmentPath(TESTING_BINARY_DIR, {"bin"},
@@ -20,14 +40,40 @@ int main() {
     auto *pinyinhelper = manager.addon("pinyinhelper", true);
     FCITX_ASSERT(pinyinhelper);
     std::vector<std::string> expect{"nǐ"};
+    auto start = std::chrono::steady_clock::now();
     auto result = pinyinhelper->call<fcitx::IPinyinHelper::lookup>(
         fcitx::utf8::getChar("你"));
+    FCITX_INFO() << "Pinyin table load: "
+                 << std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count()
+                 << "us";
     for (auto &s : result) {
         FCITX_INFO() << s << " ";
     }
     FCITX_ASSERT(result == expect);
+    std::vector<std::tuple<std::string, std::string, int>> fullResult;
+    pinyinhelper->call<fcitx::IPinyinHelper::forEachPinyin>(
+        fcitx::utf8::getChar("你"),
+        [&fullResult](std::string_view pinyin, std::string_view noTonePinyin,
+                      int tone) {
+            fullResult.emplace_back(pinyin, noTonePinyin, tone);
+        });
+    FCITX_ASSERT(fullResult ==
+                 pinyinhelper->call<fcitx::IPinyinHelper::fullLookup>(
+                     fcitx::utf8::getChar("你")));
+    FCITX_ASSERT(fullResult.size() == 1 &&
+                 std::get<1>(fullResult[0]) == "ni" &&
+                 std::get<2>(fullResult[0]) == 3);
+    const auto rss = residentSize();
+    start = std::chrono::steady_clock::now();
     auto result2 =
         pinyinhelper->call<fcitx::IPinyinHelper::lookupStroke>("2511", 3);
+    FCITX_INFO() << "Stroke data load: "
+                 << std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count()
+                 << "us, RSS delta " << residentSize() - rss << "kB";
     for (auto &s : result2) {
         FCITX_INFO()
             << s.first << " "
@@ -37,10 +83,78 @@ int main() {
     auto result3 =
         pinyinhelper->call<fcitx::IPinyinHelper::lookupStroke>("szhh", 3);
     FCITX_ASSERT(result2 == result3);
+    auto result6 =
+        pinyinhelper->call<fcitx::IPinyinHelper::lookupStroke>("3235234", 3);
+    FCITX_ASSERT(!result6.empty() && result6[0].first == "你");
+    // Cached result with a larger limit is reused for a smaller one.
+    auto result7 =
+        pinyinhelper->call<fcitx::IPinyinHelper::lookupStroke>("3235234", 1);
+    FCITX_ASSERT(result7.size() == 1 && result7[0] == result6[0]);
+
+    // Every prefix of the strokes of common chars, like typing them.
+    const std::string commonChars =
+        "的一是不了人我在有他这中大来上国个到"
+        "说们为子和你地出道也时年";
+    std::vector<std::string> strokeInputs;
+    for (auto chr : fcitx::utf8::MakeUTF8StringRange(commonChars)) {
+        auto strokes =
+            pinyinhelper->call<fcitx::IPinyinHelper::reverseLookupStroke>(
+                std::string(chr));
+        for (size_t i = 1; i <= strokes.size(); i++) {
+            strokeInputs.push_back(strokes.substr(0, i));
+        }
+    }
+    constexpr int pinyinRounds = 1000;
+    start = std::chrono::steady_clock::now();
+    size_t pinyinLength = 0;
+    for (int i = 0; i < pinyinRounds; i++) {
+        for (auto chr : fcitx::utf8::MakeUTF8CharRange(commonChars)) {
+            pinyinhelper->call<fcitx::IPinyinHelper::forEachPinyin>(
+                chr, [&pinyinLength](std::string_view pinyin,
+                                     std::string_view, int) {
+                    pinyinLength += pinyin.size();
+                });
+        }
+    }
+    FCITX_ASSERT(pinyinLength);
+    FCITX_INFO() << "Pinyin lookup: "
+                 << std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start)
+                            .count() /
+                        (pinyinRounds * fcitx::utf8::length(commonChars))
+                 << "ns per char";
+
+    for (const char *pass : {"uncached", "cached"}) {
+        start = std::chrono::steady_clock::now();
+        for (const auto &input : strokeInputs) {
+            pinyinhelper->call<fcitx::IPinyinHelper::lookupStroke>(input, 3);
+        }
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+        FCITX_INFO() << "Stroke lookup (" << pass
+                     << "): " << duration.count() / strokeInputs.size()
+                     << "us per input";
+    }
 
     auto result4 =
         pinyinhelper->call<fcitx::IPinyinHelper::reverseLookupStroke>("你");
     FCITX_ASSERT(result4 == "3235234") << result4;
+    auto packed = pinyinhelper->call<fcitx::IPinyinHelper::lookupPackedStrokes>(
+        std::vector<uint32_t>{fcitx::utf8::getChar("你"), 'a'});
+    FCITX_ASSERT(packed.size() == 2);
+    FCITX_ASSERT(packed[0] == fcitx::packStrokes("3235234"));
+    FCITX_ASSERT(packed[1] == 0);
+    FCITX_ASSERT(fcitx::packedStrokesStartsWith(packed[0],
+                                                fcitx::packStrokes("323")));
+    FCITX_ASSERT(!fcitx::packedStrokesStartsWith(packed[0],
+                                                 fcitx::packStrokes("324")));
+    FCITX_ASSERT(!fcitx::packedStrokesStartsWith(
+        packed[0], fcitx::packStrokes("32352341")));
+    FCITX_ASSERT(fcitx::packedStrokesStartsWith(packed[1], 0));
+    const std::string longest(fcitx::PackedStrokeMaxInputLength, '1');
+    FCITX_ASSERT(fcitx::packStrokes(longest) != 0);
+    FCITX_ASSERT(fcitx::packStrokes(longest + "1") == 0);
+
     auto result5 =
         pinyinhelper->call<fcitx::IPinyinHelper::prettyStrokeString>("54321");
     FCITX_ASSERT(result5 == "𠃍㇏丿丨一");
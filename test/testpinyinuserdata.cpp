@@ -0,0 +1,141 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "../im/pinyin/pinyin_public.h"
+#include "testdir.h"
+#include <cstdlib>
+#include <fcitx-utils/eventdispatcher.h>
+#include <fcitx-utils/handlertable.h>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/macros.h>
+#include <fcitx-utils/standardpaths.h>
+#include <fcitx-utils/testing.h>
+#include <fcitx/addoninstance.h>
+#include <fcitx/addonmanager.h>
+#include <fcitx/instance.h>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <iterator>
+#include <libime/core/historybigram.h>
+#include <libime/pinyin/pinyindictionary.h>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace fcitx;
+
+std::string dumpUserDict(const std::filesystem::path &path) {
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    libime::PinyinDictionary dict;
+    dict.load(libime::PinyinDictionary::UserDict, in,
+              libime::PinyinDictFormat::Binary);
+    std::ostringstream out;
+    dict.save(libime::PinyinDictionary::UserDict, out,
+              libime::PinyinDictFormat::Text);
+    return out.str();
+}
+
+// sc.dict is broken, but user dict, history and the journal are fine.
+void prepare(const std::filesystem::path &dataHome,
+             const std::filesystem::path &pinyinDir) {
+    std::filesystem::create_directories(dataHome / "libime");
+    std::ofstream(dataHome / "libime/sc.dict") << "not a dictionary";
+
+    std::filesystem::create_directories(pinyinDir);
+    {
+        libime::PinyinDictionary dict;
+        dict.addWord(libime::PinyinDictionary::UserDict, "ce'shi", "测试");
+        std::ofstream out(pinyinDir / "user.dict",
+                          std::ios::out | std::ios::binary);
+        dict.save(libime::PinyinDictionary::UserDict, out,
+                  libime::PinyinDictFormat::Binary);
+    }
+    {
+        libime::HistoryBigram history;
+        history.add(std::vector<std::string>{"测试"});
+        std::ofstream out(pinyinDir / "user.history",
+                          std::ios::out | std::ios::binary);
+        history.save(out);
+    }
+    std::ofstream(pinyinDir / "user.journal")
+        << "add\tzhong'wen\t中文\nhistory\t中文\n";
+}
+
+int main() {
+    setupTestingEnvironment(
+        TESTING_BINARY_DIR, {"bin"},
+        {TESTING_BINARY_DIR "/test", TESTING_BINARY_DIR "/im",
+         TESTING_BINARY_DIR "/modules", TESTING_SOURCE_DIR "/modules",
+         StandardPaths::fcitxPath("pkgdatadir")});
+    char dir[] = "/tmp/testpinyinuserdataXXXXXX";
+    FCITX_ASSERT(mkdtemp(dir));
+    const std::filesystem::path dataHome = dir;
+    const auto pinyinDir = dataHome / "fcitx5/pinyin";
+    // Use a user directory of this test, so the engine can save.
+    unsetenv("SKIP_FCITX_USER_PATH");
+    setenv("XDG_DATA_HOME", dataHome.c_str(), 1);
+    setenv("FCITX_DATA_HOME", (dataHome / "fcitx5").c_str(), 1);
+    setenv("FCITX_CONFIG_HOME", (dataHome / "config").c_str(), 1);
+    prepare(dataHome, pinyinDir);
+
+    {
+        char arg0[] = "testpinyinuserdata";
+        char arg1[] = "--disable=all";
+        char arg2[] = "--enable=testim,testfrontend,pinyin";
+        char *argv[] = {arg0, arg1, arg2};
+        fcitx::Log::setLogRule("default=5,pinyin=5");
+        Instance instance(FCITX_ARRAY_SIZE(argv), argv);
+        instance.addonManager().registerDefaultLoader(nullptr);
+        std::unique_ptr<HandlerTableEntry<PinyinReadyCallback>> readyWatcher;
+        instance.eventDispatcher().schedule([&instance, &readyWatcher]() {
+            auto *pinyin = instance.addonManager().addon("pinyin", true);
+            FCITX_ASSERT(pinyin);
+            auto saveAndExit = [&instance, pinyin]() {
+                pinyin->save();
+                instance.exit();
+            };
+            if (pinyin->call<IPinyinEngine::ready>()) {
+                saveAndExit();
+            } else {
+                readyWatcher = pinyin->call<IPinyinEngine::watchReady>(
+                    [&instance, saveAndExit]() {
+                        instance.eventDispatcher().schedule(saveAndExit);
+                    });
+            }
+        });
+        instance.exec();
+    }
+
+    // Pending writes are finished when the engine is destroyed. Learning
+    // from the journal is either still there, or saved with the user data.
+    const auto dict = dumpUserDict(pinyinDir / "user.dict");
+    FCITX_INFO() << "User dict: " << dict;
+    FCITX_ASSERT(dict.find("测试") != std::string::npos);
+    std::string journal;
+    {
+        std::ifstream in(pinyinDir / "user.journal",
+                         std::ios::in | std::ios::binary);
+        journal.assign(std::istreambuf_iterator<char>(in),
+                       std::istreambuf_iterator<char>());
+    }
+    FCITX_ASSERT(dict.find("中文") != std::string::npos ||
+                 journal.find("中文") != std::string::npos);
+
+    libime::HistoryBigram history;
+    {
+        std::ifstream in(pinyinDir / "user.history",
+                         std::ios::in | std::ios::binary);
+        history.load(in);
+    }
+    FCITX_ASSERT(!history.isUnknown("测试"));
+    FCITX_ASSERT(!history.isUnknown("中文") ||
+                 journal.find("中文") != std::string::npos);
+
+    std::filesystem::remove_all(dataHome);
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "../im/pinyin/quickphrasetrigger.h"
+#include <chrono>
+#include <cstddef>
+#include <fcitx-utils/log.h>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace fcitx;
+
+// Default patterns of the pinyin engine, and some more for email.
+const std::vector<std::string> patterns{
+    ".(/|@)$", "^(www|bbs|forum|mail|bbs)\\.",
+    "^(http|https|ftp|telnet|mailto):",
+    "^[a-z0-9._%+-]+@[a-z0-9-]+\\.[a-z]{2,}$"};
+
+const std::vector<std::string> inputs{
+    "",
+    "nihao",
+    "www.",
+    "wwwa",
+    "bbs.fcitx",
+    "http:",
+    "https://github.com",
+    "htt",
+    "a/",
+    "/",
+    "@",
+    "user@",
+    "user@example.com",
+    "user@example.c",
+    "zhongguo/",
+    "forum.",
+    "mailto:x"};
+
+bool regexMatch(const std::vector<std::string> &patterns,
+                const std::string &text) {
+    for (const auto &pattern : patterns) {
+        if (std::regex_search(text, std::regex(pattern))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void testMatch(const std::vector<std::string> &patterns) {
+    QuickPhraseTrigger trigger;
+    trigger.compile(patterns);
+    FCITX_ASSERT(trigger.size() == patterns.size());
+    for (const auto &input : inputs) {
+        FCITX_ASSERT(trigger.match(input) == regexMatch(patterns, input))
+            << input;
+        // Type it char by char.
+        QuickPhraseTrigger::Cursor cursor;
+        for (size_t i = 0; i <= input.size(); i++) {
+            const auto text = input.substr(0, i);
+            FCITX_ASSERT(trigger.match(cursor, text) ==
+                         regexMatch(patterns, text))
+                << text;
+        }
+    }
+}
+
+void testPatterns() {
+    testMatch(patterns);
+    testMatch({"a*b+c?$", "^x{2,3}$", "(?:ab|cd)e", "[^a-z]", "\\d\\.\\w",
+               "[\\-.]{2}", "^$"});
+
+    QuickPhraseTrigger trigger;
+    // Back reference and lookahead are left to std::regex, invalid one is
+    // skipped.
+    trigger.compile({"(a)\\1", "x(?=y)", "(", "^www\\."});
+    FCITX_ASSERT(trigger.size() == 3);
+    FCITX_ASSERT(trigger.fallbackSize() == 2);
+    FCITX_ASSERT(trigger.match("aa"));
+    FCITX_ASSERT(trigger.match("xy"));
+    FCITX_ASSERT(trigger.match("www."));
+    FCITX_ASSERT(!trigger.match("ab"));
+}
+
+void benchmark() {
+    constexpr int rounds = 200;
+    std::vector<std::regex> regexes;
+    for (const auto &pattern : patterns) {
+        regexes.emplace_back(pattern);
+    }
+    QuickPhraseTrigger trigger;
+    trigger.compile(patterns);
+
+    size_t regexMatched = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        for (const auto &input : inputs) {
+            for (size_t j = 1; j <= input.size(); j++) {
+                const auto text = input.substr(0, j);
+                for (const auto &reg : regexes) {
+                    if (std::regex_search(text, reg)) {
+                        regexMatched++;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    auto regexTime = std::chrono::steady_clock::now() - start;
+
+    size_t triggerMatched = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        for (const auto &input : inputs) {
+            QuickPhraseTrigger::Cursor cursor;
+            for (size_t j = 1; j <= input.size(); j++) {
+                const auto text = std::string_view(input).substr(0, j);
+                if (trigger.match(cursor, text)) {
+                    triggerMatched++;
+                }
+            }
+        }
+    }
+    auto triggerTime = std::chrono::steady_clock::now() - start;
+    FCITX_ASSERT(regexMatched == triggerMatched);
+
+    FCITX_INFO() << "std::regex: "
+                 << std::chrono::duration_cast<std::chrono::microseconds>(
+                        regexTime)
+                        .count()
+                 << "us, QuickPhraseTrigger: "
+                 << std::chrono::duration_cast<std::chrono::microseconds>(
+                        triggerTime)
+                        .count()
+                 << "us";
+}
+
+int main() {
+    testPatterns();
+    benchmark();
+    return 0;
+}
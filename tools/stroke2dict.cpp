@@ -0,0 +1,75 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+
+#include "strokedata.h"
+#include <exception>
+#include <fcitx-utils/log.h>
+#include <fstream>
+#include <getopt.h>
+#include <ios>
+#include <iostream>
+#include <ostream>
+
+using namespace fcitx;
+
+namespace {
+
+void usage(std::ostream &out) {
+    out << "stroke2dict - Compile py_stroke.mb into the binary format used "
+           "by pinyinhelper\n"
+           "\n"
+           "  usage: stroke2dict [OPTION] [source] [output]\n"
+           "\n"
+           "  -h         display this help.\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int c;
+    while ((c = getopt(argc, argv, "h")) != -1) {
+        switch (c) {
+        case 'h':
+            usage(std::cout);
+            return 0;
+        default:
+            usage(std::cerr);
+            return 1;
+        }
+    }
+
+    if (optind + 2 != argc) {
+        usage(std::cerr);
+        return 1;
+    }
+
+    std::ifstream in(argv[optind], std::ios::in | std::ios::binary);
+    if (!in) {
+        FCITX_ERROR() << "Cannot open file: " << argv[optind];
+        return 1;
+    }
+    std::ofstream out(argv[optind + 1],
+                      std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out) {
+        FCITX_ERROR() << "Cannot open file: " << argv[optind + 1];
+        return 1;
+    }
+
+    try {
+        saveStrokeData(out, parseStrokeText(in));
+        out.close();
+        if (!out) {
+            FCITX_ERROR() << "Failed to write " << argv[optind + 1];
+            return 1;
+        }
+    } catch (const std::exception &e) {
+        FCITX_ERROR() << e.what();
+        return 1;
+    }
+
+    return 0;
+}